@@ -1,9 +1,22 @@
+#if defined(CONFIG_TARGET_LINUX)
+	#include <fcntl.h>
+	#include <unistd.h>
+#endif
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <limits>
+#include <sstream>
+
 #include "computer.h"
 #include "terminal.h"
 #include "disk.h"
 #include "timer.h"
 #include "memory.h"
 #include "cpu.h"
+#include "../snapshot.h"
+#include "../os/os.h"
 
 // ---------------------------------------
 
@@ -11,12 +24,12 @@ namespace Arch {
 
 // ---------------------------------------
 
-Computer::Computer ()
+Computer::Computer (const bool headless)
 {
 	for (auto& port: this->io_ports)
 		port = nullptr;
 	
-	this->terminal = new Terminal(*this);
+	this->terminal = new Terminal(*this, headless);
 	this->disk = new Disk(*this);
 	this->timer = new Timer(*this);
 	this->memory = new Memory(*this);
@@ -35,13 +48,298 @@ Computer::~Computer ()
 		delete device;
 }
 
-void Computer::run ()
+void Computer::run (const uint64_t max_cycles)
 {
-	while (this->alive) {
+	while (this->alive && this->cycle < max_cycles) {
+		if (this->cpu->is_halted()) {
+			this->skip_idle_cycles(max_cycles);
+
+			if (!this->alive)
+				break;
+		}
+
 		for (auto *device: this->devices)
 			device->run_cycle();
 		this->cycle++;
+
+		if (!this->snapshot_fname.empty()) [[unlikely]]
+			this->save_requested_snapshot();
+
+		if (this->cycle >= this->next_checkpoint_cycle) [[unlikely]]
+			this->save_checkpoint();
+	}
+
+	this->event_trace.finish(this->cycle);
+	this->cpu->write_reports();
+	this->memory->write_reports();
+}
+
+void Computer::start_event_trace (const std::string_view fname)
+{
+	this->event_trace.start(fname);
+
+	// from now on the OS begins the spans of the cpu track
+	if (this->cpu->is_halted())
+		this->event_trace.begin_idle(this->cycle);
+	else
+		this->event_trace.begin_context(this->cycle, this->cpu->get_context_id());
+}
+
+void Computer::skip_idle_cycles (const uint64_t max_cycles)
+{
+	uint64_t ncycles = std::numeric_limits<uint64_t>::max();
+
+	for (auto *device: this->devices)
+		ncycles = std::min(ncycles, device->get_idle_cycles());
+
+	// Nothing will ever happen, so just keep running cycle by cycle,
+	// unless not even a key can wake up the machine.
+	if (ncycles == std::numeric_limits<uint64_t>::max()) {
+		if (this->terminal->is_input_closed())
+			this->turn_off();
+		return;
+	}
+
+	// the cycle at max_cycles - 1 still runs
+	ncycles = std::min(ncycles, max_cycles - this->cycle - 1);
+
+	if (ncycles == 0)
+		return;
+
+	for (auto *device: this->devices)
+		device->skip_cycles(ncycles);
+
+	this->cycle += ncycles;
+}
+
+void Computer::save_snapshot (std::ostream& stream) const
+{
+	Lib::SnapshotWriter out(stream);
+
+	out.put_string(Lib::snapshot_magic);
+	out.put(Lib::snapshot_version);
+	out.put(this->cycle);
+
+	for (const auto *device: this->devices)
+		device->save_state(out);
+
+	OS::snapshot_save(out);
+
+	out.check();
+}
+
+void Computer::load_snapshot (std::istream& stream, const int fd)
+{
+	Lib::SnapshotReader in(stream, fd);
+
+	const std::string magic = in.get_string();
+
+	if (magic == Lib::checkpoint_magic) {
+		this->load_checkpoint(in);
+		return;
+	}
+
+	mylib_assert_exception_msg(magic == Lib::snapshot_magic, "not a snapshot file")
+
+	const uint32_t version = in.get<uint32_t>();
+	mylib_assert_exception_msg(version == Lib::snapshot_version, "unsupported snapshot version ", version)
+
+	this->cycle = in.get<uint64_t>();
+
+	for (auto *device: this->devices)
+		device->load_state(in);
+
+	OS::snapshot_restore(this->cpu, in);
+}
+
+void Computer::load_snapshot (const std::string_view fname)
+{
+	std::ifstream stream(fname.data(), std::ios::binary);
+	mylib_assert_exception_msg(stream.is_open(), "cannot open snapshot ", fname)
+
+#if defined(CONFIG_TARGET_LINUX)
+	// the mapping of the memory image survives closing the fd
+	const int fd = open(fname.data(), O_RDONLY);
+	mylib_assert_exception_msg(fd >= 0, "cannot open snapshot ", fname)
+
+	try {
+		this->load_snapshot(stream, fd);
+	}
+	catch (...) {
+		close(fd);
+		throw;
+	}
+
+	close(fd);
+#else
+	this->load_snapshot(stream);
+#endif
+}
+
+std::string Computer::save_state_blob () const
+{
+	std::ostringstream stream;
+	Lib::SnapshotWriter out(stream);
+
+	for (const auto *device: this->devices) {
+		if (device != this->memory)
+			device->save_state(out);
+	}
+
+	OS::snapshot_save(out);
+
+	out.check();
+
+	return std::move(stream).str();
+}
+
+void Computer::load_state_blob (const std::string& blob)
+{
+	std::istringstream stream(blob);
+	Lib::SnapshotReader in(stream);
+
+	for (auto *device: this->devices) {
+		if (device != this->memory)
+			device->load_state(in);
 	}
+
+	OS::snapshot_restore(this->cpu, in);
+}
+
+void Computer::start_checkpoints (const std::string_view fname, const uint64_t interval)
+{
+	mylib_assert_exception_msg(interval > 0, "checkpoint interval must not be 0")
+
+	this->checkpoint_fname = fname;
+	this->write_checkpoint_base();
+
+	this->checkpoint_interval = interval;
+	this->next_checkpoint_cycle = this->cycle + interval;
+}
+
+// Replaces the checkpoint file with the whole machine, as it is now.
+void Computer::write_checkpoint_base ()
+{
+	// The memory may be mapped from a previous checkpoint in the same file,
+	// so the base is written apart and only replaces it once complete.
+	const std::string tmp_fname = this->checkpoint_fname + ".tmp";
+
+	if (this->checkpoint_file.is_open())
+		this->checkpoint_file.close();
+
+	{
+		std::ofstream file(tmp_fname, std::ios::binary);
+		mylib_assert_exception_msg(file.is_open(), "cannot open checkpoint file ", tmp_fname)
+
+		Lib::SnapshotWriter out(file);
+
+		out.put_string(Lib::checkpoint_magic);
+		out.put(Lib::snapshot_version);
+		out.put(this->cycle);
+		this->memory->save_state(out);
+		out.put_string(this->save_state_blob());
+		out.check();
+
+		this->checkpoint_base_bytes = file.tellp();
+
+		file.close();
+		mylib_assert_exception_msg(!file.fail(), "error writing checkpoint file ", tmp_fname)
+	}
+
+	std::filesystem::rename(tmp_fname, this->checkpoint_fname);
+
+	this->checkpoint_file.open(this->checkpoint_fname, std::ios::binary | std::ios::app);
+	mylib_assert_exception_msg(this->checkpoint_file.is_open(), "cannot open checkpoint file ", this->checkpoint_fname)
+
+	this->memory->clear_dirty_frames();
+	this->checkpoint_appended_bytes = 0;
+}
+
+void Computer::save_checkpoint ()
+{
+	try {
+		if (this->checkpoint_appended_bytes >= this->checkpoint_base_bytes)
+			this->write_checkpoint_base();
+		else {
+			std::ostringstream payload;
+			Lib::SnapshotWriter record(payload);
+
+			record.put(this->cycle);
+			this->memory->save_dirty_frames(record);
+			record.put_string(this->save_state_blob());
+			record.check();
+
+			// a single write, the restore ignores a record cut short
+			Lib::SnapshotWriter out(this->checkpoint_file);
+			out.put_record(payload.view());
+			out.check();
+
+			this->checkpoint_file.flush();
+			mylib_assert_exception_msg(this->checkpoint_file.good(), "error writing checkpoint file")
+
+			this->memory->clear_dirty_frames();
+			this->checkpoint_appended_bytes += payload.view().size();
+		}
+
+		this->next_checkpoint_cycle = this->cycle + this->checkpoint_interval;
+	}
+	catch (const std::exception& e) {
+		this->next_checkpoint_cycle = std::numeric_limits<uint64_t>::max();
+		this->checkpoint_file.close();
+
+		this->terminal->print_str(Terminal::Type::Kernel, Mylib::build_str_from_stream("checkpoints to ", this->checkpoint_fname, " stopped at cycle ", this->cycle, ": ", e.what(), '\n'));
+	}
+}
+
+void Computer::load_checkpoint (Lib::SnapshotReader& in)
+{
+	const uint32_t version = in.get<uint32_t>();
+	mylib_assert_exception_msg(version == Lib::snapshot_version, "unsupported snapshot version ", version)
+
+	this->cycle = in.get<uint64_t>();
+	this->memory->load_state(in);
+
+	// only the state of the last checkpoint is loaded, all of them have the whole state
+	std::string blob = in.get_string();
+
+	while (const auto payload = in.get_record()) {
+		std::istringstream stream(*payload);
+		Lib::SnapshotReader record(stream);
+
+		this->cycle = record.get<uint64_t>();
+		this->memory->load_dirty_frames(record);
+		blob = record.get_string();
+	}
+
+	this->load_state_blob(blob);
+}
+
+void Computer::save_requested_snapshot ()
+{
+	const std::string fname = std::move(this->snapshot_fname);
+	this->snapshot_fname.clear();
+
+	std::string msg;
+
+	try {
+		const std::string tmp_fname = fname + ".tmp";
+
+		{
+			std::ofstream file(tmp_fname, std::ios::binary);
+			mylib_assert_exception_msg(file.is_open(), "cannot open file")
+
+			this->save_snapshot(file);
+		}
+
+		std::filesystem::rename(tmp_fname, fname);
+
+		msg = Mylib::build_str_from_stream("snapshot saved to ", fname, " at cycle ", this->cycle, '\n');
+	}
+	catch (const std::exception& e) {
+		msg = Mylib::build_str_from_stream("cannot save snapshot to ", fname, ": ", e.what(), '\n');
+	}
+
+	this->terminal->print_str(Terminal::Type::Kernel, msg);
 }
 
 // ---------------------------------------
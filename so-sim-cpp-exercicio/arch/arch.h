@@ -11,7 +11,9 @@
 #include "computer.h"
 #include "cpu.h"
 #include "disk.h"
+#include "input-log.h"
 #include "memory.h"
+#include "profiler.h"
 #include "terminal.h"
 #include "timer.h"
 
@@ -2,7 +2,13 @@
 #define __ARQSIM_HEADER_ARCH_COMPUTER_H__
 
 #include <array>
+#include <fstream>
+#include <istream>
+#include <limits>
 #include <list>
+#include <ostream>
+#include <string>
+#include <string_view>
 
 #include <cstdint>
 
@@ -11,6 +17,8 @@
 
 #include "../config.h"
 #include "device.h"
+#include "input-log.h"
+#include "event-trace.h"
 
 namespace Arch {
 
@@ -38,13 +46,32 @@ private:
 
 	std::string turn_off_msg;
 
+	// see request_snapshot
+	std::string snapshot_fname;
+
+	// see start_checkpoints
+	std::ofstream checkpoint_file;
+	std::string checkpoint_fname;
+	uint64_t checkpoint_interval = 0;
+	uint64_t next_checkpoint_cycle = std::numeric_limits<uint64_t>::max();
+	uint64_t checkpoint_base_bytes = 0;
+	uint64_t checkpoint_appended_bytes = 0;
+
+	InputLog input_log;
+	EventTrace event_trace;
+
+	// the machine of the interactive simulator, see init
 	inline static Computer *computer = nullptr;
 
-private:
-	Computer ();
+public:
+	// Machines don't share any state, so many of them can run at the same
+	// time in different threads, as long as they are headless and each
+	// thread runs a single machine (the kernel state is per thread).
+	Computer (const bool headless = false);
 	~Computer ();
 
-public:
+	// The interactive simulator has a single machine, reachable from
+	// anywhere. Devices and the kernel only use the machine they belong to.
 	static void init ()
 	{
 		mylib_assert_exception(computer == nullptr)
@@ -64,7 +91,104 @@ public:
 		computer = nullptr;
 	}
 
-	void run ();
+	// Runs until turned off or max_cycles is reached.
+	// A headless machine is also turned off when nothing can happen anymore:
+	// the cpu is halted, no device is busy and no key will be typed.
+	void run (const uint64_t max_cycles = std::numeric_limits<uint64_t>::max());
+
+	/*
+		Snapshots hold the whole machine: the devices, the cycle counter
+		and the kernel state, so the restored machine continues running
+		from where it was saved instead of booting.
+		load_snapshot replaces OS::boot.
+		Both raise Mylib::Exception in case of error.
+	*/
+	void save_snapshot (std::ostream& stream) const;
+
+	// fd is the file of the stream, if any, see Memory::map_image
+	void load_snapshot (std::istream& stream, const int fd = -1);
+
+	// machines restored from the same file share its memory image
+	void load_snapshot (const std::string_view fname);
+
+	// Saved at the end of the current cycle, when no device or interrupt
+	// handler is halfway through something. The result is printed in
+	// the kernel terminal. The file is replaced only once the snapshot
+	// is complete, so machines that mapped the old one keep it.
+	inline void request_snapshot (const std::string_view fname)
+	{
+		this->snapshot_fname = fname;
+	}
+
+	/*
+		Checkpoints the machine every interval cycles to a single file,
+		restored like a snapshot. The file starts with the whole machine,
+		as it is when called, and each checkpoint appends only the page
+		frames written since the previous one, with the state of the
+		devices and the kernel. A restore applies the pages of every
+		checkpoint in order, ignoring a last one that was cut short.
+		Once the appended checkpoints are larger than the base, the next
+		one rewrites the file with a new base, so neither the file nor
+		the restore grow without bound.
+		Raises Mylib::Exception if the file cannot be written, later
+		errors are printed in the kernel terminal and stop the checkpoints.
+	*/
+	void start_checkpoints (const std::string_view fname, const uint64_t interval);
+
+	/*
+		Records the keys and host clock reads from now on, or feeds back
+		the ones of a recording instead of taking them from the host.
+		Called after OS::boot or load_snapshot, and a replay must start
+		from the same state the recording did.
+		Both raise Mylib::Exception in case of error.
+	*/
+	inline void record_input (const std::string_view fname)
+	{
+		this->input_log.start_record(fname, this->cycle);
+	}
+
+	inline void replay_input (const std::string_view fname)
+	{
+		this->input_log.start_replay(fname, this->cycle);
+	}
+
+	// Writes the timeline of the machine from now on, until run returns.
+	// Raises Mylib::Exception if the file cannot be created.
+	void start_event_trace (const std::string_view fname);
+
+private:
+	void skip_idle_cycles (const uint64_t max_cycles);
+	void save_requested_snapshot ();
+	void save_checkpoint ();
+	void write_checkpoint_base ();
+
+	// the devices other than the memory, and the kernel
+	std::string save_state_blob () const;
+	void load_state_blob (const std::string& blob);
+
+	void load_checkpoint (Lib::SnapshotReader& in);
+
+public:
+
+	inline uint64_t get_cycle () const
+	{
+		return this->cycle;
+	}
+
+	inline bool is_alive () const
+	{
+		return this->alive;
+	}
+
+	inline InputLog& get_input_log ()
+	{
+		return this->input_log;
+	}
+
+	inline EventTrace& get_event_trace ()
+	{
+		return this->event_trace;
+	}
 
 	inline Terminal& get_terminal () const
 	{
@@ -1,3 +1,5 @@
+#include <fstream>
+
 #include "cpu.h"
 #include "terminal.h"
 #include "../os/os.h"
@@ -26,13 +28,52 @@ static const char* get_reg_name_str (const uint16_t code)
 	return strs[code];
 }
 
+// highest priority first
+static constexpr auto interrupt_priority = std::to_array<InterruptCode>({
+	InterruptCode::Timer,
+	InterruptCode::Disk,
+	InterruptCode::Keyboard,
+	});
+
+static constexpr auto opcode_r_names = std::to_array<std::pair<Cpu::OpcodeR, const char*>>({
+	{ Cpu::OpcodeR::Add, "add" },
+	{ Cpu::OpcodeR::Sub, "sub" },
+	{ Cpu::OpcodeR::Mul, "mul" },
+	{ Cpu::OpcodeR::Div, "div" },
+	{ Cpu::OpcodeR::Cmp_equal, "cmp_equal" },
+	{ Cpu::OpcodeR::Cmp_neq, "cmp_neq" },
+	{ Cpu::OpcodeR::Load, "load" },
+	{ Cpu::OpcodeR::Store, "store" },
+	{ Cpu::OpcodeR::Syscall, "syscall" },
+	});
+
+static constexpr auto opcode_i_names = std::to_array<std::pair<Cpu::OpcodeI, const char*>>({
+	{ Cpu::OpcodeI::Jump, "jump" },
+	{ Cpu::OpcodeI::Jump_cond, "jump_cond" },
+	{ Cpu::OpcodeI::Mov, "mov" },
+	});
+
+// ---------------------------------------
+
+template <typename... Types>
+void Cpu::trace_println (Types&&... vars) const
+{
+	if (this->trace)
+		dprintln(this->computer, vars...);
+}
+
 // ---------------------------------------
 
 Cpu::Cpu (Computer& computer)
-	: Device(computer)
+	: IO_Device(computer)
 {
 	for (auto& r: this->gprs)
 		r = 0;
+
+	this->computer.set_io_port(IO_Port::CpuCounterSelect, this);
+
+	for (uint16_t i = 0; i < 4; i++)
+		this->computer.set_io_port(std::to_underlying(IO_Port::CpuCounter0) + i, this);
 }
 
 Cpu::~Cpu ()
@@ -47,18 +88,43 @@ void Cpu::run_cycle ()
 		I = 1
 	};
 
-	if (this->has_interrupt) { // check first if external interrupt
-		this->has_interrupt = false;
-		OS::interrupt(this->interrupt_code);
-		return;
+	if (this->profiler) [[unlikely]]
+		this->profiler->run_cycle(this->halted, this->context_id, this->pc);
+
+	// check first if external interrupt,
+	// only one is delivered per cycle, by order of priority
+
+	if (const uint16_t deliverable = this->get_deliverable_interrupts()) {
+		for (const InterruptCode code : interrupt_priority) {
+			if (deliverable & interrupt_bit(code)) {
+				this->pending_interrupts &= ~interrupt_bit(code);
+				this->halted = false;
+				this->busy_cycles++;
+				this->counters[CounterIndex::Interrupts + std::to_underlying(code)]++;
+
+				if (EventTrace& trace = this->computer.get_event_trace(); trace.is_on()) [[unlikely]]
+					trace.instant(this->computer.get_cycle(), TraceTrack::Cpu, enum_class_to_str(code), "interrupt");
+
+				OS::interrupt(code);
+				return;
+			}
+		}
 	}
 
+	if (this->halted)
+		return;
+
+	this->busy_cycles++;
 	this->backup_pc = this->pc;
 	
 	try {
+		// counted before, so that a syscall that switches
+		// process is accounted to the process that issued it
+		this->instructions_retired++;
+
 		const Instruction instruction = this->vmem_read_instruction(this->pc);
 
-		dprintln("\tPC = ", this->pc, " instr 0x", std::hex, instruction.to_underlying(), std::dec, " binary ", instruction.to_underlying());
+		this->trace_println("\tPC = ", this->pc, " instr 0x", std::hex, instruction.to_underlying(), std::dec, " binary ", instruction.to_underlying());
 
 		this->pc++;
 
@@ -70,49 +136,180 @@ void Cpu::run_cycle ()
 			this->execute_i(instruction);
 	}
 	catch (const CpuException& e) {
+		this->instructions_retired--;
 		this->pc = this->backup_pc;
 		this->cpu_exception = e;
+		this->counters[CounterIndex::Exceptions + std::to_underlying(e.type)]++;
+		this->counters[CounterIndex::Interrupts + std::to_underlying(InterruptCode::CpuException)]++;
+
+		if (EventTrace& trace = this->computer.get_event_trace(); trace.is_on()) [[unlikely]]
+			trace.instant(this->computer.get_cycle(), TraceTrack::Cpu, enum_class_to_str(e.type), "exception", "vaddr", e.vaddr);
 
 		OS::interrupt(InterruptCode::CpuException);
 	}
 
-	this->dump();
+	if (this->trace)
+		this->dump();
 }
 
-void Cpu::turn_off ()
+uint64_t Cpu::get_idle_cycles () const
 {
-	this->computer.turn_off();
+	if (this->halted && this->get_deliverable_interrupts() == 0)
+		return std::numeric_limits<uint64_t>::max();
+	return 0;
 }
 
-bool Cpu::interrupt (const InterruptCode interrupt_code)
+void Cpu::skip_cycles (const uint64_t ncycles)
 {
-	if (this->has_interrupt)
-		return false;
-	this->interrupt_code = interrupt_code;
-	this->has_interrupt = true;
-	return true;
+	if (this->profiler)
+		this->profiler->skip_cycles(ncycles);
 }
 
-void Cpu::force_interrupt (const InterruptCode interrupt_code)
+void Cpu::start_profiler (const uint32_t interval, const std::string_view report_fname, const std::string_view map_fname)
 {
-	mylib_assert_exception(this->has_interrupt == false)
-	this->interrupt(interrupt_code);
+	this->profiler = std::make_unique<Profiler>(interval, report_fname, map_fname);
 }
 
-void Cpu::execute_r (const Instruction instruction)
+void Cpu::write_counters (std::ostream& out) const
 {
-	enum class OpcodeR : uint16_t {
-		Add = 0,
-		Sub = 1,
-		Mul = 2,
-		Div = 3,
-		Cmp_equal = 4,
-		Cmp_neq = 5,
-		Load = 15,
-		Store = 16,
-		Syscall = 63
-	};
+	const uint64_t taken = this->counters[CounterIndex::JumpCondTaken];
+	const uint64_t jump_cond = this->counters[CounterIndex::OpcodesI + std::to_underlying(OpcodeI::Jump_cond)];
+
+	out << "instructions " << this->instructions_retired << '\n';
+	out << "busy_cycles " << this->busy_cycles << '\n';
+
+	for (const auto& [opcode, name] : opcode_r_names)
+		out << "opcode." << name << ' ' << this->counters[CounterIndex::OpcodesR + std::to_underlying(opcode)] << '\n';
+
+	for (const auto& [opcode, name] : opcode_i_names)
+		out << "opcode." << name << ' ' << this->counters[CounterIndex::OpcodesI + std::to_underlying(opcode)] << '\n';
+
+	out << "jump_cond.taken " << taken << '\n';
+	out << "jump_cond.not_taken " << (jump_cond - taken) << '\n';
+
+	for (uint16_t i = 0; i < CounterIndex::Interrupts - CounterIndex::Exceptions; i++)
+		out << "exception." << static_cast<CpuException::Type>(i) << ' ' << this->counters[CounterIndex::Exceptions + i] << '\n';
+
+	for (uint16_t i = 0; i < CounterIndex::Count - CounterIndex::Interrupts; i++)
+		out << "interrupt." << static_cast<InterruptCode>(i) << ' ' << this->counters[CounterIndex::Interrupts + i] << '\n';
+}
+
+void Cpu::write_reports () const
+{
+	if (this->profiler)
+		this->profiler->write_report();
+
+	if (!this->counters_report_fname.empty()) {
+		std::ofstream file(this->counters_report_fname);
+		mylib_assert_exception_msg(file.is_open(), "cannot open counters report ", this->counters_report_fname)
+
+		this->write_counters(file);
+
+		mylib_assert_exception_msg(file.good(), "error writing counters report ", this->counters_report_fname)
+	}
+}
+
+uint16_t Cpu::read (const uint16_t port)
+{
+	const IO_Port port_enum = static_cast<IO_Port>(port);
+	uint16_t r;
 
+	switch (port_enum) {
+		using enum IO_Port;
+
+		case CpuCounterSelect:
+			r = this->counter_selected;
+		break;
+
+		case CpuCounter0:
+			this->latched_counter = this->counters[this->counter_selected];
+			[[fallthrough]];
+		case CpuCounter1:
+		case CpuCounter2:
+		case CpuCounter3:
+			r = this->latched_counter >> (16 * (port - std::to_underlying(CpuCounter0)));
+		break;
+
+		default:
+			mylib_throw_exception_msg("Cpu read invalid port ", port);
+	}
+
+	return r;
+}
+
+void Cpu::write (const uint16_t port, const uint16_t value)
+{
+	const IO_Port port_enum = static_cast<IO_Port>(port);
+
+	switch (port_enum) {
+		using enum IO_Port;
+
+		case CpuCounterSelect:
+			mylib_assert_exception_msg(value < this->counters.size(), "invalid cpu counter ", value)
+			this->counter_selected = value;
+		break;
+
+		default:
+			mylib_throw_exception_msg("Cpu write invalid port ", port);
+	}
+}
+
+void Cpu::save_state (Lib::SnapshotWriter& out) const
+{
+	out.put_section("cpu");
+	out.put(this->gprs);
+	out.put(this->pending_interrupts);
+	out.put(this->halted);
+	out.put(this->backup_pc);
+	out.put(this->pc);
+	out.put(this->vmem_mode);
+	out.put(this->vmem_paddr_base);
+	out.put(this->vmem_size);
+	out.put(this->cpu_exception);
+	out.put(this->interrupt_mask);
+	out.put(this->trace);
+	out.put(this->busy_cycles);
+	out.put(this->instructions_retired);
+	out.put(this->counters);
+	out.put(this->counter_selected);
+	out.put(this->latched_counter);
+}
+
+void Cpu::load_state (Lib::SnapshotReader& in)
+{
+	in.expect_section("cpu");
+	this->gprs = in.get<decltype(this->gprs)>();
+	this->pending_interrupts = in.get<uint16_t>();
+	this->halted = in.get<bool>();
+	this->backup_pc = in.get<uint16_t>();
+	this->pc = in.get<uint16_t>();
+	this->vmem_mode = in.get<VmemMode>();
+	this->vmem_paddr_base = in.get<uint16_t>();
+	this->vmem_size = in.get<uint16_t>();
+	this->cpu_exception = in.get<CpuException>();
+	this->interrupt_mask = in.get<uint16_t>();
+	this->trace = in.get<bool>();
+	this->busy_cycles = in.get<uint64_t>();
+	this->instructions_retired = in.get<uint64_t>();
+	this->counters = in.get<decltype(this->counters)>();
+	this->counter_selected = in.get<uint16_t>();
+	this->latched_counter = in.get<uint64_t>();
+	this->page_table = nullptr;
+	this->context_id = 0;
+}
+
+void Cpu::turn_off ()
+{
+	this->computer.turn_off();
+}
+
+void Cpu::interrupt (const InterruptCode interrupt_code)
+{
+	this->pending_interrupts |= interrupt_bit(interrupt_code);
+}
+
+void Cpu::execute_r (const Instruction instruction)
+{
 	const OpcodeR opcode = static_cast<OpcodeR>( instruction[{9, 6}] );
 	const uint16_t dest = instruction[{6, 3}];
 	const uint16_t op1 = instruction[{3, 3}];
@@ -122,47 +319,47 @@ void Cpu::execute_r (const Instruction instruction)
 		using enum OpcodeR;
 
 		case Add:
-			dprintln("\tadd ", get_reg_name_str(dest), ", ", get_reg_name_str(op1), ", ", get_reg_name_str(op2));
+			this->trace_println("\tadd ", get_reg_name_str(dest), ", ", get_reg_name_str(op1), ", ", get_reg_name_str(op2));
 			this->gprs[dest] = this->gprs[op1] + this->gprs[op2];
 		break;
 
 		case Sub:
-			dprintln("\tsub ", get_reg_name_str(dest), ", ", get_reg_name_str(op1), ", ", get_reg_name_str(op2));
+			this->trace_println("\tsub ", get_reg_name_str(dest), ", ", get_reg_name_str(op1), ", ", get_reg_name_str(op2));
 			this->gprs[dest] = this->gprs[op1] - this->gprs[op2];
 		break;
 
 		case Mul:
-			dprintln("\tmul ", get_reg_name_str(dest), ", ", get_reg_name_str(op1), ", ", get_reg_name_str(op2));
+			this->trace_println("\tmul ", get_reg_name_str(dest), ", ", get_reg_name_str(op1), ", ", get_reg_name_str(op2));
 			this->gprs[dest] = this->gprs[op1] * this->gprs[op2];
 		break;
 
 		case Div:
-			dprintln("\tdiv ", get_reg_name_str(dest), ", ", get_reg_name_str(op1), ", ", get_reg_name_str(op2));
+			this->trace_println("\tdiv ", get_reg_name_str(dest), ", ", get_reg_name_str(op1), ", ", get_reg_name_str(op2));
 			this->gprs[dest] = this->gprs[op1] / this->gprs[op2];
 		break;
 
 		case Cmp_equal:
-			dprintln("\tcmp_equal ", get_reg_name_str(dest), ", ", get_reg_name_str(op1), ", ", get_reg_name_str(op2));
+			this->trace_println("\tcmp_equal ", get_reg_name_str(dest), ", ", get_reg_name_str(op1), ", ", get_reg_name_str(op2));
 			this->gprs[dest] = (this->gprs[op1] == this->gprs[op2]);
 		break;
 
 		case Cmp_neq:
-			dprintln("\tcmp_neq ", get_reg_name_str(dest), ", ", get_reg_name_str(op1), ", ", get_reg_name_str(op2));
+			this->trace_println("\tcmp_neq ", get_reg_name_str(dest), ", ", get_reg_name_str(op1), ", ", get_reg_name_str(op2));
 			this->gprs[dest] = (this->gprs[op1] != this->gprs[op2]);
 		break;
 
 		case Load:
-			dprintln("\tload ", get_reg_name_str(dest), ", [", get_reg_name_str(op1), "]");
+			this->trace_println("\tload ", get_reg_name_str(dest), ", [", get_reg_name_str(op1), "]");
 			this->gprs[dest] = this->vmem_read( this->gprs[op1] );
 		break;
 
 		case Store:
-			dprintln("\tstore [", get_reg_name_str(op1), "], ", get_reg_name_str(op2));
+			this->trace_println("\tstore [", get_reg_name_str(op1), "], ", get_reg_name_str(op2));
 			this->vmem_write(this->gprs[op1], this->gprs[op2]);
 		break;
 
 		case Syscall:
-			dprintln("\tsyscall");
+			this->trace_println("\tsyscall");
 			OS::syscall();
 		break;
 
@@ -172,16 +369,12 @@ void Cpu::execute_r (const Instruction instruction)
 				.vaddr = this->backup_pc
 				};
 	}
+
+	this->counters[CounterIndex::OpcodesR + std::to_underlying(opcode)]++;
 }
 
 void Cpu::execute_i (const Instruction instruction)
 {
-	enum class OpcodeI : uint16_t {
-		Jump = 0,
-		Jump_cond = 1,
-		Mov = 3
-	};
-
 	const OpcodeI opcode = static_cast<OpcodeI>( instruction[{13, 2}] );
 	const uint16_t reg = instruction[{10, 3}];
 	const uint16_t imed = instruction[{0, 9}];
@@ -190,18 +383,20 @@ void Cpu::execute_i (const Instruction instruction)
 		using enum OpcodeI;
 
 		case Jump:
-			dprintln("\tjump ", imed);
+			this->trace_println("\tjump ", imed);
 			this->pc = imed;
 		break;
 
 		case Jump_cond:
-			dprintln("\tjump_cond ", get_reg_name_str(reg), ", ", imed);
-			if (this->gprs[reg] == 1)
+			this->trace_println("\tjump_cond ", get_reg_name_str(reg), ", ", imed);
+			if (this->gprs[reg] == 1) {
 				this->pc = imed;
+				this->counters[CounterIndex::JumpCondTaken]++;
+			}
 		break;
 
 		case Mov:
-			dprintln("\tmov ", get_reg_name_str(reg), ", ", imed);
+			this->trace_println("\tmov ", get_reg_name_str(reg), ", ", imed);
 			this->gprs[reg] = imed;
 		break;
 
@@ -211,6 +406,8 @@ void Cpu::execute_i (const Instruction instruction)
 				.vaddr = this->backup_pc
 				};
 	}
+
+	this->counters[CounterIndex::OpcodesI + std::to_underlying(opcode)]++;
 }
 
 uint16_t Cpu::vmem_to_phys (const uint16_t vaddr, const MemAccessType access_type)
@@ -291,10 +488,10 @@ uint16_t Cpu::vmem_to_phys (const uint16_t vaddr, const MemAccessType access_typ
 
 void Cpu::dump () const
 {
-	dprint("gprs:");
+	dprint(this->computer, "gprs:");
 	for (uint32_t i = 0; i < this->gprs.size(); i++)
-		dprint(" ", this->gprs[i]);
-	dprintln();
+		dprint(this->computer, " ", this->gprs[i]);
+	dprintln(this->computer);
 }
 
 const char* enum_class_to_str (const Cpu::CpuException::Type value)
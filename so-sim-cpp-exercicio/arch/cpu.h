@@ -2,6 +2,10 @@
 #define __ARQSIM_HEADER_ARCH_CPU_H__
 
 #include <array>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <string_view>
 
 #include <my-lib/std.h>
 #include <my-lib/macros.h>
@@ -11,12 +15,13 @@
 #include "device.h"
 #include "memory.h"
 #include "computer.h"
+#include "profiler.h"
 
 namespace Arch {
 
 // ---------------------------------------
 
-class Cpu : public Device
+class Cpu : public IO_Device
 {
 public:
 	enum VmemMode : uint16_t {
@@ -57,13 +62,42 @@ public:
 	using PageTableEntry = Mylib::BitSet<32>;
 	using PageTable = std::array<PageTableEntry, Config::ptes_per_table>;
 
+	enum class OpcodeR : uint16_t {
+		Add = 0,
+		Sub = 1,
+		Mul = 2,
+		Div = 3,
+		Cmp_equal = 4,
+		Cmp_neq = 5,
+		Load = 15,
+		Store = 16,
+		Syscall = 63
+	};
+
+	enum class OpcodeI : uint16_t {
+		Jump = 0,
+		Jump_cond = 1,
+		Mov = 3
+	};
+
+	// Index of each counter of the instruction mix, as read
+	// through CpuCounterSelect. Only retired instructions count.
+	struct CounterIndex {
+		static constexpr uint16_t OpcodesR = 0; // + opcode
+		static constexpr uint16_t OpcodesI = OpcodesR + 64; // + opcode
+		static constexpr uint16_t JumpCondTaken = OpcodesI + 4;
+		static constexpr uint16_t Exceptions = JumpCondTaken + 1; // + CpuException::Type
+		static constexpr uint16_t Interrupts = Exceptions + std::to_underlying(CpuException::Type::GPFinvalidInstruction) + 1; // + InterruptCode
+		static constexpr uint16_t Count = Interrupts + std::to_underlying(InterruptCode::CpuException) + 1;
+	};
+
 private:
 	using Instruction = Mylib::BitSet<16>;
 
 	std::array<uint16_t, Config::nregs> gprs;
-	InterruptCode interrupt_code;
-	bool has_interrupt = false;
-	uint16_t backup_pc;
+	uint16_t pending_interrupts = 0; // one bit per InterruptCode
+	bool halted = false; // waiting for an interrupt, see halt()
+	uint16_t backup_pc = 0;
 
 	MYLIB_OO_ENCAPSULATE_SCALAR(uint16_t, pc)
 	MYLIB_OO_ENCAPSULATE_SCALAR_INIT(VmemMode, vmem_mode, VmemMode::Disabled)
@@ -72,15 +106,68 @@ private:
 	MYLIB_OO_ENCAPSULATE_PTR_INIT(PageTable*, page_table, nullptr)
 	MYLIB_OO_ENCAPSULATE_OBJ_READONLY(CpuException, cpu_exception)
 
+	// one bit per InterruptCode, a set bit keeps the interrupt pending
+	MYLIB_OO_ENCAPSULATE_SCALAR_INIT(uint16_t, interrupt_mask, 0)
+
 	MYLIB_OO_ENCAPSULATE_SCALAR_INIT_READONLY(uint16_t, pmem_size_words, Config::phys_mem_size_words)
 
+	// prints every instruction in the Arch terminal, slows down the simulation a lot
+	MYLIB_OO_ENCAPSULATE_SCALAR_INIT(bool, trace, true)
+
+	// for accounting, busy_cycles doesn't count the cycles spent halted
+	MYLIB_OO_ENCAPSULATE_SCALAR_INIT_READONLY(uint64_t, busy_cycles, 0)
+	MYLIB_OO_ENCAPSULATE_SCALAR_INIT_READONLY(uint64_t, instructions_retired, 0)
+
+	// set by the OS to the pid of the running process, only used by the profiler
+	MYLIB_OO_ENCAPSULATE_SCALAR_INIT(uint16_t, context_id, 0)
+
+	std::array<uint64_t, CounterIndex::Count> counters = {};
+	uint16_t counter_selected = 0;
+	uint64_t latched_counter = 0; // read in 16-bit words, see CpuCounter0
+
+	std::unique_ptr<Profiler> profiler; // nullptr unless profiling
+	std::string counters_report_fname; // empty if not wanted
+
 public:
 	Cpu (Computer& computer);
 	~Cpu ();
 
 	void run_cycle () override final;
+	uint64_t get_idle_cycles () const override final;
+	void skip_cycles (const uint64_t ncycles) override final;
 	void dump () const;
 
+	uint16_t read (const uint16_t port) override final;
+	void write (const uint16_t port, const uint16_t value) override final;
+
+	// Samples the pc every interval cycles, see Profiler.
+	// raises Mylib::Exception if the map file cannot be read
+	void start_profiler (const uint32_t interval, const std::string_view report_fname, const std::string_view map_fname = "");
+
+	// see CounterIndex
+	inline uint64_t get_counter (const uint16_t index) const
+	{
+		mylib_assert_exception(index < this->counters.size())
+		return this->counters[index];
+	}
+
+	// the instruction mix, one "name value" line per counter
+	void write_counters (std::ostream& out) const;
+
+	inline void set_counters_report (const std::string_view fname)
+	{
+		this->counters_report_fname = fname;
+	}
+
+	// The profile and the counters, those that were asked for.
+	// Called when the machine stops, raises Mylib::Exception in case of error.
+	void write_reports () const;
+
+	// page_table is a pointer to kernel memory, so it is not saved,
+	// the OS sets it and context_id again when restored
+	void save_state (Lib::SnapshotWriter& out) const override final;
+	void load_state (Lib::SnapshotReader& in) override final;
+
 	inline uint16_t get_gpr (const uint8_t code) const
 	{
 		mylib_assert_exception(code < this->gprs.size())
@@ -93,14 +180,29 @@ public:
 		this->gprs[code] = v;
 	}
 
+	// the instruction being executed, or the last one if between instructions
+	inline uint16_t get_instruction_pc () const
+	{
+		return this->backup_pc;
+	}
+
+	// Called by the kernel when the running syscall rewinds the pc to run
+	// again later, so that only the attempt that completes is counted.
+	inline void restart_syscall ()
+	{
+		this->pc--;
+		this->instructions_retired--;
+		this->counters[CounterIndex::OpcodesR + std::to_underlying(OpcodeR::Syscall)]--; // incremented when the syscall returns
+	}
+
 	inline uint16_t pmem_read (const uint16_t paddr) const
 	{
-		return this->computer.get_memory()[paddr];
+		return this->computer.get_memory().read(paddr);
 	}
 
 	inline void pmem_write (const uint16_t paddr, const uint16_t value)
 	{
-		this->computer.get_memory()[paddr] = value;
+		this->computer.get_memory().write(paddr, value);
 	}
 
 	inline uint16_t read_io (const uint16_t port)
@@ -123,14 +225,46 @@ public:
 		this->write_io(std::to_underlying(port), value);
 	}
 
-	bool interrupt (const InterruptCode interrupt_code);
-	void force_interrupt (const InterruptCode interrupt_code);
+	// Raising an interrupt that is already pending does nothing,
+	// so devices don't need to retry.
+	void interrupt (const InterruptCode interrupt_code);
 	void turn_off ();
 
+	inline bool is_interrupt_pending (const InterruptCode interrupt_code) const
+	{
+		return this->pending_interrupts & interrupt_bit(interrupt_code);
+	}
+
+	static constexpr uint16_t interrupt_bit (const InterruptCode interrupt_code)
+	{
+		return 1 << std::to_underlying(interrupt_code);
+	}
+
+	// Stops fetching instructions until the next external interrupt.
+	// Used by the OS when there is nothing to run.
+	inline void halt ()
+	{
+		this->halted = true;
+	}
+
+	inline bool is_halted () const
+	{
+		return this->halted;
+	}
+
 private:
+	inline uint16_t get_deliverable_interrupts () const
+	{
+		return this->pending_interrupts & ~this->interrupt_mask;
+	}
+
 	void execute_r (const Instruction instruction);
 	void execute_i (const Instruction instruction);
 
+	// only used in cpu.cpp
+	template <typename... Types>
+	void trace_println (Types&&... vars) const;
+
 	uint16_t vmem_to_phys (const uint16_t vaddr, const MemAccessType access_type);
 
 	inline uint16_t vmem_read_instruction (const uint16_t vaddr)
@@ -1,10 +1,13 @@
 #ifndef __ARQSIM_HEADER_ARCH_DEVICE_H__
 #define __ARQSIM_HEADER_ARCH_DEVICE_H__
 
+#include <limits>
+
 #include <my-lib/std.h>
 #include <my-lib/macros.h>
 
 #include "../config.h"
+#include "../snapshot.h"
 
 namespace Arch {
 
@@ -28,14 +31,36 @@ inline std::ostream& operator << (std::ostream& out, const InterruptCode value)
 enum class IO_Port : uint16_t {
 	TerminalSet               = 0,   // write
 	TerminalUpload            = 1,   // write
-	TerminalReadTypedChar     = 2,   // read
+	TerminalReadTypedChar     = 2,   // read, 0 if there is no typed char
+	TerminalTypedCount        = 3,   // read
+	TerminalDmaAddr           = 4,   // write
+	TerminalDmaRead           = 5,   // read/write
+	TerminalReadCommandChar   = 6,   // read, 0 if there is no char typed in the command terminal
 	TimerInterruptCycles      = 10,  // read/write
 	TimerGetTimeSeconds       = 11,  // read
+	TimerCycles0              = 12,  // read, latches the 64-bit cycle counter and returns bits 0-15
+	TimerCycles1              = 13,  // read, bits 16-31 of the latched cycle counter
+	TimerCycles2              = 14,  // read, bits 32-47 of the latched cycle counter
+	TimerCycles3              = 15,  // read, bits 48-63 of the latched cycle counter
+	TimerTimeUs0              = 16,  // read, latches the 64-bit microseconds since power on and returns bits 0-15
+	TimerTimeUs1              = 17,  // read, bits 16-31 of the latched microseconds
+	TimerTimeUs2              = 18,  // read, bits 32-47 of the latched microseconds
+	TimerTimeUs3              = 19,  // read, bits 48-63 of the latched microseconds
 	DiskCmd                   = 20,  // write
 	DiskData		          = 21,  // read/write
 	DiskFileID		          = 22,  // read/write
 	DiskState                 = 23,  // read
 	DiskError                 = 24,  // read
+	TimerChannelSelect        = 30,  // read/write, channel accessed by the TimerChannel* ports
+	TimerChannelMode          = 31,  // read/write, writing (re)starts the channel
+	TimerChannelCycles0       = 32,  // read/write, bits 0-15 of the channel interval
+	TimerChannelCycles1       = 33,  // read/write, bits 16-31 of the channel interval
+	TimerFiredChannels        = 34,  // read, bitmask of the channels that fired since the last read, then clears it
+	CpuCounterSelect          = 40,  // read/write, counter of the instruction mix read by the CpuCounter* ports, see Cpu::CounterIndex
+	CpuCounter0               = 41,  // read, latches the selected 64-bit counter and returns bits 0-15
+	CpuCounter1               = 42,  // read, bits 16-31 of the latched counter
+	CpuCounter2               = 43,  // read, bits 32-47 of the latched counter
+	CpuCounter3               = 44,  // read, bits 48-63 of the latched counter
 };
 
 // ---------------------------------------
@@ -55,6 +80,29 @@ public:
 
 	virtual ~Device () = default;
 	virtual void run_cycle () = 0;
+
+	inline Computer& get_computer () const
+	{
+		return this->computer;
+	}
+
+	// Used to fast-forward the simulation while the cpu is halted.
+	// Returns how many cycles can be skipped before the device has
+	// something to do (e.g. raise an interrupt).
+	virtual uint64_t get_idle_cycles () const
+	{
+		return std::numeric_limits<uint64_t>::max();
+	}
+
+	// advances the device's internal counters as if
+	// run_cycle had been called ncycles times
+	virtual void skip_cycles (const uint64_t ncycles)
+	{
+	}
+
+	// whole device state, see Computer::save_snapshot
+	virtual void save_state (Lib::SnapshotWriter& out) const = 0;
+	virtual void load_state (Lib::SnapshotReader& in) = 0;
 };
 
 // ---------------------------------------
@@ -1,3 +1,4 @@
+#include <array>
 #include <limits>
 
 #include "disk.h"
@@ -8,6 +9,16 @@
 
 namespace Arch {
 
+static constexpr auto cmd_names = std::to_array<const char*>({
+	"set_fname",
+	"open_file",
+	"close_file",
+	"read_file",
+	"write_file",
+	"get_file_size",
+	"seek_file_pos",
+	});
+
 // ---------------------------------------
 
 Disk::Disk (Computer& computer)
@@ -36,10 +47,34 @@ void Disk::run_cycle ()
 
 		case ReadingFile:
 			if (this->count >= Config::disk_interrupt_cycles) {
-				if (this->computer.get_cpu().interrupt(InterruptCode::Disk)) {
-					this->count = 0;
-					this->state = State::UploadingFileSize;
-				}
+				this->computer.get_event_trace().end(this->computer.get_cycle(), TraceTrack::Disk);
+				this->computer.get_cpu().interrupt(InterruptCode::Disk);
+				this->count = 0;
+				this->state = State::UploadingFileSize;
+			}
+			else
+				this->count++;
+		break;
+
+		case WritingFile:
+			if (this->count >= Config::disk_interrupt_cycles) {
+				auto& file = this->current_file_descriptor->file;
+
+				// switching from reading to writing requires a seek,
+				// and a previous read may have hit the end of the file
+				file.clear();
+				file.seekp(file.tellg());
+				file.write(reinterpret_cast<const char*>(this->buffer.data()), this->buffer.size());
+				file.flush();
+				file.seekg(file.tellp());
+
+				this->error = file.good() ? Error::NoError : Error::CannotWriteFile;
+				file.clear();
+
+				this->computer.get_event_trace().end(this->computer.get_cycle(), TraceTrack::Disk);
+				this->computer.get_cpu().interrupt(InterruptCode::Disk);
+				this->count = 0;
+				this->state = State::Idle;
 			}
 			else
 				this->count++;
@@ -49,6 +84,90 @@ void Disk::run_cycle ()
 	}
 }
 
+uint64_t Disk::get_idle_cycles () const
+{
+	if (this->state != State::ReadingFile && this->state != State::WritingFile)
+		return std::numeric_limits<uint64_t>::max();
+	else if (this->count >= Config::disk_interrupt_cycles)
+		return 0;
+	return Config::disk_interrupt_cycles - this->count;
+}
+
+void Disk::skip_cycles (const uint64_t ncycles)
+{
+	if (this->state == State::ReadingFile || this->state == State::WritingFile) {
+		mylib_assert_exception(ncycles <= this->get_idle_cycles())
+		this->count += ncycles;
+	}
+}
+
+void Disk::save_state (Lib::SnapshotWriter& out) const
+{
+	out.put_section("disk");
+	out.put<uint32_t>(this->file_descriptors.size());
+
+	for (const auto& [id, desc] : this->file_descriptors) {
+		desc.file.clear();
+
+		out.put(id);
+		out.put_string(desc.fname);
+		out.put<int64_t>(desc.file.tellg());
+	}
+
+	out.put(this->count);
+	out.put(this->next_id);
+	out.put(this->state);
+	out.put_string(this->fname);
+	out.put(this->data_written);
+	out.put(this->data_result);
+	out.put_vector(this->buffer);
+	out.put<uint16_t>((this->current_file_descriptor == nullptr) ? 0 : this->current_file_descriptor->id);
+	out.put(this->error);
+}
+
+void Disk::load_state (Lib::SnapshotReader& in)
+{
+	in.expect_section("disk");
+
+	this->file_descriptors.clear();
+	this->current_file_descriptor = nullptr;
+
+	const uint32_t nfiles = in.get<uint32_t>();
+
+	for (uint32_t i = 0; i < nfiles; i++) {
+		FileDescriptor desc;
+		desc.id = in.get<uint16_t>();
+		desc.fname = in.get_string();
+
+		const int64_t pos = in.get<int64_t>();
+
+		if (!open_file(desc))
+			mylib_throw_exception_msg("cannot open ", desc.fname, " to restore the snapshot");
+
+		desc.file.seekg(pos);
+		desc.file.seekp(pos);
+
+		this->file_descriptors.insert(std::make_pair(desc.id, std::move(desc)));
+	}
+
+	this->count = in.get<uint32_t>();
+	this->next_id = in.get<uint16_t>();
+	this->state = in.get<State>();
+	this->fname = in.get_string();
+	this->data_written = in.get<uint16_t>();
+	this->data_result = in.get<uint16_t>();
+	this->buffer = in.get_vector<uint8_t>();
+
+	// ids of open files are never 0
+	if (const uint16_t current_id = in.get<uint16_t>(); current_id != 0) {
+		const auto it = this->file_descriptors.find(current_id);
+		mylib_assert_exception(it != this->file_descriptors.end())
+		this->current_file_descriptor = &it->second;
+	}
+
+	this->error = in.get<Error>();
+}
+
 uint16_t Disk::read (const uint16_t port)
 {
 	const IO_Port port_enum = static_cast<IO_Port>(port);
@@ -128,6 +247,11 @@ void Disk::process_cmd (const uint16_t cmd_)
 	if (this->state != State::Idle)
 		return;
 
+	if (EventTrace& trace = this->computer.get_event_trace(); trace.is_on() && cmd_ < cmd_names.size()) [[unlikely]] {
+		const uint16_t id = (this->current_file_descriptor != nullptr) ? this->current_file_descriptor->id : 0;
+		trace.instant(this->computer.get_cycle(), TraceTrack::Disk, cmd_names[cmd_], "disk", "file", id);
+	}
+
 	switch (cmd)
 	{
 		using enum Cmd;
@@ -152,9 +276,8 @@ void Disk::process_cmd (const uint16_t cmd_)
 			desc.id = this->next_id++;
 			mylib_assert_exception(desc.id < std::numeric_limits<uint16_t>::max())
 			desc.fname = std::move(this->fname);
-			desc.file.open(desc.fname.data(), std::ios::binary | std::ios_base::in);
 
-			if (!desc.file.is_open()) {
+			if (!open_file(desc)) {
 				this->current_file_descriptor = nullptr;
 				this->error = Error::CannotOpenFile;
 				return;
@@ -200,6 +323,42 @@ void Disk::process_cmd (const uint16_t cmd_)
 			this->state = State::ReadingFile;
 			this->count = 0;
 			this->error = Error::NoError;
+
+			// until the interrupt
+			this->computer.get_event_trace().begin(this->computer.get_cycle(), TraceTrack::Disk, "read", "disk", "file", this->current_file_descriptor->id);
+		break;
+
+		case WriteFile:
+			if (this->current_file_descriptor == nullptr) {
+				this->error = Error::InvalidFileDescriptor;
+				return;
+			}
+
+			// the data_written bytes are sent through the data port
+			this->buffer.clear();
+			this->state = (this->data_written > 0) ? State::DownloadingFile : State::Idle;
+			this->count = 0;
+			this->error = Error::NoError;
+
+			if (this->state == State::DownloadingFile)
+				this->computer.get_event_trace().begin(this->computer.get_cycle(), TraceTrack::Disk, "write", "disk", "file", this->current_file_descriptor->id);
+		break;
+
+		case SeekFilePos: {
+			if (this->current_file_descriptor == nullptr) {
+				this->error = Error::InvalidFileDescriptor;
+				return;
+			}
+
+			auto& file = this->current_file_descriptor->file;
+
+			file.clear();
+			file.seekg(this->data_written);
+			file.seekp(this->data_written);
+
+			this->error = file.good() ? Error::NoError : Error::InvalidFilePos;
+			file.clear();
+		}
 		break;
 
 		case GetFileSize: {
@@ -300,11 +459,31 @@ void Disk::process_data_write (const uint16_t value)
 		}
 		break;
 
+		case DownloadingFile:
+			this->buffer.push_back(static_cast<uint8_t>(value));
+
+			if (this->buffer.size() == this->data_written) {
+				this->state = State::WritingFile;
+				this->count = 0;
+			}
+		break;
+
 		default:
 			mylib_throw_exception_msg("Disk invalid state ", static_cast<uint16_t>(this->state));
 	}
 }
 
+bool Disk::open_file (FileDescriptor& desc)
+{
+	desc.file.open(desc.fname.data(), std::ios::binary | std::ios_base::in | std::ios_base::out);
+
+	// read-only files can still be read
+	if (!desc.file.is_open())
+		desc.file.open(desc.fname.data(), std::ios::binary | std::ios_base::in);
+
+	return desc.file.is_open();
+}
+
 std::fstream::pos_type Disk::get_file_size (std::fstream& file)
 {
 	const auto pos = file.tellg();
@@ -34,6 +34,8 @@ public:
 		ReadingFile             = 2,
 		UploadingFileSize       = 3,
 		UploadingFile           = 4,
+		DownloadingFile         = 5,
+		WritingFile             = 6,
 	};
 
 	enum class Error : uint16_t {
@@ -41,13 +43,15 @@ public:
 		CannotOpenFile          = 1,
 		FileAlreadyOpen         = 2,
 		InvalidFileDescriptor   = 3,
+		CannotWriteFile         = 4,
+		InvalidFilePos          = 5,
 	};
 
 private:
 	struct FileDescriptor {
 		uint16_t id;
 		std::string fname;
-		std::fstream file;
+		mutable std::fstream file; // the position is read when saving a snapshot
 	};
 
 private:
@@ -67,15 +71,24 @@ public:
 	~Disk ();
 
 	void run_cycle () override final;
+	uint64_t get_idle_cycles () const override final;
+	void skip_cycles (const uint64_t ncycles) override final;
 	uint16_t read (const uint16_t port) override final;
 	void write (const uint16_t port, const uint16_t value) override final;
 
+	// open files are saved by name and position, and opened again when restored
+	void save_state (Lib::SnapshotWriter& out) const override final;
+	void load_state (Lib::SnapshotReader& in) override final;
+
 private:
 	void process_cmd (const uint16_t cmd_);
 	uint16_t process_data_read ();
 	void process_data_write (const uint16_t value);
 
 	static std::fstream::pos_type get_file_size (std::fstream& file);
+
+	// returns false if the file cannot be opened
+	static bool open_file (FileDescriptor& desc);
 };
 
 // ---------------------------------------
@@ -0,0 +1,141 @@
+#include "event-trace.h"
+
+// ---------------------------------------
+
+namespace Arch {
+
+// ---------------------------------------
+
+static constexpr auto track_names = std::to_array<const char*>({
+	"cpu",
+	"disk",
+	});
+
+static_assert(track_names.size() == std::to_underlying(TraceTrack::Count));
+
+// ---------------------------------------
+
+void EventTrace::start (const std::string_view fname)
+{
+	mylib_assert_exception(!this->on)
+
+	this->out.open(fname.data());
+	mylib_assert_exception_msg(this->out.is_open(), "cannot open event trace ", fname)
+
+	this->out << "[\n";
+	this->out << "{\"name\": \"process_name\", \"ph\": \"M\", \"pid\": 1, \"args\": {\"name\": \"arq-sim\"}}";
+
+	for (uint16_t i = 0; i < track_names.size(); i++)
+		this->out << ",\n{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": " << i << ", \"args\": {\"name\": \"" << track_names[i] << "\"}}";
+
+	mylib_assert_exception_msg(this->out.good(), "error writing event trace")
+
+	this->events.reserve(buffer_events);
+	this->host_start = Clock::now();
+	this->on = true;
+}
+
+void EventTrace::begin (const uint64_t cycle, const TraceTrack track, std::string name, const char *category, const char *arg_name, const uint64_t arg_value)
+{
+	if (!this->on)
+		return;
+
+	std::string& open = this->open_spans[ std::to_underlying(track) ];
+
+	if (open == name)
+		return;
+
+	if (!open.empty())
+		this->end(cycle, track);
+
+	open = name;
+	this->push(cycle, Phase::Begin, track, std::move(name), category, arg_name, arg_value);
+}
+
+void EventTrace::end (const uint64_t cycle, const TraceTrack track)
+{
+	if (!this->on)
+		return;
+
+	std::string& open = this->open_spans[ std::to_underlying(track) ];
+
+	if (open.empty())
+		return;
+
+	open.clear();
+	this->push(cycle, Phase::End, track, "", nullptr, nullptr, 0);
+}
+
+void EventTrace::instant (const uint64_t cycle, const TraceTrack track, std::string name, const char *category, const char *arg_name, const uint64_t arg_value)
+{
+	if (this->on)
+		this->push(cycle, Phase::Instant, track, std::move(name), category, arg_name, arg_value);
+}
+
+void EventTrace::finish (const uint64_t cycle)
+{
+	if (!this->on)
+		return;
+
+	for (uint16_t i = 0; i < this->open_spans.size(); i++)
+		this->end(cycle, static_cast<TraceTrack>(i));
+
+	this->flush();
+	this->out << "\n]\n";
+	this->out.close();
+
+	mylib_assert_exception_msg(!this->out.fail(), "error writing event trace")
+
+	this->on = false;
+}
+
+void EventTrace::push (const uint64_t cycle, const Phase phase, const TraceTrack track, std::string name, const char *category, const char *arg_name, const uint64_t arg_value)
+{
+	const auto host_us = std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - this->host_start).count();
+
+	this->events.push_back(Event {
+		.cycle = cycle,
+		.host_us = static_cast<uint64_t>(host_us),
+		.phase = phase,
+		.track = track,
+		.name = std::move(name),
+		.category = category,
+		.arg_name = arg_name,
+		.arg_value = arg_value
+		});
+
+	if (this->events.size() >= buffer_events)
+		this->flush();
+}
+
+void EventTrace::flush ()
+{
+	for (const Event& event : this->events) {
+		this->out << ",\n{\"ph\": \"" << static_cast<char>(event.phase) << "\"";
+
+		if (event.phase != Phase::End)
+			this->out << ", \"name\": \"" << event.name << "\", \"cat\": \"" << event.category << "\"";
+
+		// instant events only mark their own track
+		if (event.phase == Phase::Instant)
+			this->out << ", \"s\": \"t\"";
+
+		this->out << ", \"ts\": " << event.cycle
+			<< ", \"pid\": 1, \"tid\": " << std::to_underlying(event.track)
+			<< ", \"args\": {\"host_us\": " << event.host_us;
+
+		if (event.arg_name != nullptr)
+			this->out << ", \"" << event.arg_name << "\": " << event.arg_value;
+
+		this->out << "}}";
+	}
+
+	this->events.clear();
+	this->out.flush();
+
+	mylib_assert_exception_msg(this->out.good(), "error writing event trace")
+}
+
+// ---------------------------------------
+
+} // end namespace
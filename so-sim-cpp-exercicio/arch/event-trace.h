@@ -0,0 +1,119 @@
+#ifndef __ARQSIM_HEADER_ARCH_EVENT_TRACE_H__
+#define __ARQSIM_HEADER_ARCH_EVENT_TRACE_H__
+
+#include <array>
+#include <chrono>
+#include <fstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <cstdint>
+
+#include <my-lib/std.h>
+#include <my-lib/macros.h>
+
+namespace Arch {
+
+// ---------------------------------------
+
+// rows of the timeline
+enum class TraceTrack : uint16_t {
+	Cpu      = 0, // what the cpu runs, interrupts, exceptions and syscalls
+	Disk     = 1, // commands and reads/writes in flight
+	Count
+};
+
+/*
+	Timeline of what happens in the machine, written as a Chrome trace
+	(JSON array format), which chrome://tracing and ui.perfetto.dev open.
+
+	The timestamps are cycles, so one microsecond of the timeline is one
+	cycle, and every event also has the host time in its args.
+
+	A track holds one span at a time: beginning a span ends the one that
+	was open, so the cpu track shows which process ran (or idle) at each
+	cycle. Instant events mark interrupts, exceptions and syscalls.
+
+	A machine is only touched by the thread running it, so the events go
+	to a plain buffer, written to the file whenever it fills up. The
+	closing bracket is only written by finish, but the viewers accept a
+	trace without it, so what was written before a crash can still be
+	looked at.
+*/
+
+class EventTrace
+{
+public:
+	enum class Phase : char {
+		Begin       = 'B',
+		End         = 'E',
+		Instant     = 'i',
+	};
+
+	struct Event {
+		uint64_t cycle;
+		uint64_t host_us;
+		Phase phase;
+		TraceTrack track;
+		std::string name;
+		const char *category;
+		const char *arg_name; // nullptr if no arg
+		uint64_t arg_value;
+	};
+
+	static constexpr uint32_t buffer_events = 4096;
+
+private:
+	using Clock = std::chrono::steady_clock;
+
+	bool on = false;
+	std::ofstream out;
+	Clock::time_point host_start; // host time is not seen by the guest, so not recorded by InputLog
+
+	std::vector<Event> events;
+	std::array<std::string, std::to_underlying(TraceTrack::Count)> open_spans; // name, empty if none
+
+public:
+	inline bool is_on () const
+	{
+		return this->on;
+	}
+
+	// raises Mylib::Exception if the file cannot be created
+	void start (const std::string_view fname);
+
+	// Does nothing if a span with the same name is already open in the track.
+	void begin (const uint64_t cycle, const TraceTrack track, std::string name, const char *category, const char *arg_name = nullptr, const uint64_t arg_value = 0);
+
+	void end (const uint64_t cycle, const TraceTrack track);
+
+	// spans of the cpu track, context_id as set in the Cpu
+	inline void begin_context (const uint64_t cycle, const uint16_t context_id)
+	{
+		if (this->on)
+			this->begin(cycle, TraceTrack::Cpu, Mylib::build_str_from_stream("pid ", context_id), "process", "pid", context_id);
+	}
+
+	inline void begin_idle (const uint64_t cycle)
+	{
+		this->begin(cycle, TraceTrack::Cpu, "idle", "process");
+	}
+
+	void instant (const uint64_t cycle, const TraceTrack track, std::string name, const char *category, const char *arg_name = nullptr, const uint64_t arg_value = 0);
+
+	// ends the open spans and closes the file
+	void finish (const uint64_t cycle);
+
+private:
+	void push (const uint64_t cycle, const Phase phase, const TraceTrack track, std::string name, const char *category, const char *arg_name, const uint64_t arg_value);
+
+	// raises Mylib::Exception in case of error
+	void flush ();
+};
+
+// ---------------------------------------
+
+} // end namespace
+
+#endif
@@ -0,0 +1,154 @@
+#include <string>
+
+#include "input-log.h"
+#include "../snapshot.h"
+
+// ---------------------------------------
+
+namespace Arch {
+
+// ---------------------------------------
+
+static constexpr std::string_view input_log_magic = "ARQINPUT";
+static constexpr uint32_t input_log_version = 1;
+
+static void write_varint (std::ostream& out, uint64_t value)
+{
+	while (value >= 0x80) {
+		out.put(static_cast<char>((value & 0x7F) | 0x80));
+		value >>= 7;
+	}
+
+	out.put(static_cast<char>(value));
+}
+
+// std::nullopt at the end of the stream
+static std::optional<uint64_t> read_varint (std::istream& in)
+{
+	uint64_t value = 0;
+
+	for (uint32_t shift = 0; shift < 64; shift += 7) {
+		const int byte = in.get();
+
+		if (byte == std::char_traits<char>::eof()) {
+			mylib_assert_exception_msg(shift == 0, "input log truncated")
+			return std::nullopt;
+		}
+
+		value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+
+		if ((byte & 0x80) == 0)
+			return value;
+	}
+
+	mylib_throw_exception_msg("input log corrupted");
+}
+
+// ---------------------------------------
+
+void InputLog::start_record (const std::string_view fname, const uint64_t start_cycle)
+{
+	mylib_assert_exception(this->mode == Mode::Off)
+
+	this->out.open(fname.data(), std::ios::binary);
+	mylib_assert_exception_msg(this->out.is_open(), "cannot open input log ", fname)
+
+	Lib::SnapshotWriter header(this->out);
+	header.put_string(input_log_magic);
+	header.put(input_log_version);
+	header.put(start_cycle);
+	header.check();
+
+	this->out.flush();
+	this->last_cycle = start_cycle;
+	this->mode = Mode::Record;
+}
+
+void InputLog::start_replay (const std::string_view fname, const uint64_t start_cycle)
+{
+	mylib_assert_exception(this->mode == Mode::Off)
+
+	this->in.open(fname.data(), std::ios::binary);
+	mylib_assert_exception_msg(this->in.is_open(), "cannot open input log ", fname)
+
+	Lib::SnapshotReader header(this->in);
+	mylib_assert_exception_msg(header.get_string() == input_log_magic, "not an input log")
+
+	const uint32_t version = header.get<uint32_t>();
+	mylib_assert_exception_msg(version == input_log_version, "unsupported input log version ", version)
+
+	const uint64_t log_start_cycle = header.get<uint64_t>();
+	mylib_assert_exception_msg(log_start_cycle == start_cycle, "input log recorded from cycle ", log_start_cycle, ", machine is at cycle ", start_cycle)
+
+	this->last_cycle = start_cycle;
+	this->mode = Mode::Replay;
+	this->read_next();
+}
+
+void InputLog::record (const uint64_t cycle, const InputDevice device, const uint64_t value)
+{
+	if (this->mode != Mode::Record)
+		return;
+
+	write_varint(this->out, cycle - this->last_cycle);
+	this->out.put(static_cast<char>(device));
+	write_varint(this->out, value);
+	this->out.flush();
+
+	mylib_assert_exception_msg(this->out.good(), "error writing input log")
+
+	this->last_cycle = cycle;
+}
+
+std::optional<uint64_t> InputLog::replay (const uint64_t cycle, const InputDevice device)
+{
+	if (!this->next)
+		return std::nullopt;
+
+	mylib_assert_exception_msg(this->next->cycle >= cycle, "replay diverged, input of cycle ", this->next->cycle, " not taken at cycle ", cycle)
+
+	if (this->next->cycle != cycle || this->next->device != device)
+		return std::nullopt;
+
+	const uint64_t value = this->next->value;
+	this->read_next();
+
+	return value;
+}
+
+uint64_t InputLog::replay_expected (const uint64_t cycle, const InputDevice device)
+{
+	const std::optional<uint64_t> value = this->replay(cycle, device);
+
+	mylib_assert_exception_msg(value.has_value(), "replay diverged, no input of device ", std::to_underlying(device), " at cycle ", cycle)
+
+	return *value;
+}
+
+void InputLog::read_next ()
+{
+	const std::optional<uint64_t> delta = read_varint(this->in);
+
+	if (!delta) {
+		this->next = std::nullopt;
+		return;
+	}
+
+	const int device = this->in.get();
+	const std::optional<uint64_t> value = read_varint(this->in);
+
+	mylib_assert_exception_msg(device != std::char_traits<char>::eof() && value.has_value(), "input log truncated")
+	mylib_assert_exception_msg(device <= std::to_underlying(InputDevice::Timer), "input log corrupted")
+
+	this->last_cycle += *delta;
+
+	this->next = Event {
+		.cycle = this->last_cycle,
+		.device = static_cast<InputDevice>(device),
+		.value = *value
+		};
+}
+
+// ---------------------------------------
+
+} // end namespace
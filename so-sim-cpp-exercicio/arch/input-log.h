@@ -0,0 +1,106 @@
+#ifndef __ARQSIM_HEADER_ARCH_INPUT_LOG_H__
+#define __ARQSIM_HEADER_ARCH_INPUT_LOG_H__
+
+#include <fstream>
+#include <limits>
+#include <optional>
+#include <string_view>
+
+#include <cstdint>
+
+#include <my-lib/std.h>
+#include <my-lib/macros.h>
+
+namespace Arch {
+
+// ---------------------------------------
+
+// devices whose inputs come from the host
+enum class InputDevice : uint8_t {
+	Terminal    = 0, // typed key
+	Timer       = 1, // host microseconds since power on
+};
+
+/*
+	Everything the host feeds into the machine at its own pace: typed
+	keys and host clock reads. Recording them with the cycle they entered
+	the machine and feeding them back at the same cycles runs the guest
+	exactly as before, as long as it starts from the same state (boot or
+	the same snapshot) and finds the same disk files.
+
+	The log is a header followed by one entry per input: the cycle as a
+	delta from the previous entry, the device, and the value, the numbers
+	as LEB128 varints. Entries are flushed as they are written, so the log
+	is complete even if the simulator crashes.
+
+	Replay raises Mylib::Exception as soon as the guest takes a different
+	path, i.e. it reads the clock at a cycle the log doesn't expect.
+*/
+
+class InputLog
+{
+public:
+	enum class Mode {
+		Off,
+		Record,
+		Replay,
+	};
+
+	struct Event {
+		uint64_t cycle;
+		InputDevice device;
+		uint64_t value;
+	};
+
+private:
+	Mode mode = Mode::Off;
+	std::ofstream out;
+	std::ifstream in;
+
+	uint64_t last_cycle = 0; // base of the next delta
+	std::optional<Event> next; // replay, std::nullopt at the end of the log
+
+public:
+	inline Mode get_mode () const
+	{
+		return this->mode;
+	}
+
+	inline bool is_replaying () const
+	{
+		return this->mode == Mode::Replay;
+	}
+
+	// start_cycle is the cycle the machine is at, checked when replaying
+	void start_record (const std::string_view fname, const uint64_t start_cycle);
+	void start_replay (const std::string_view fname, const uint64_t start_cycle);
+
+	// does nothing unless recording
+	void record (const uint64_t cycle, const InputDevice device, const uint64_t value);
+
+	// value of the next input if it is for device at this cycle
+	std::optional<uint64_t> replay (const uint64_t cycle, const InputDevice device);
+
+	// as replay, but the input must be there
+	uint64_t replay_expected (const uint64_t cycle, const InputDevice device);
+
+	// cycle of the next input for device, max if it is for another device or the log ended
+	uint64_t get_next_cycle (const InputDevice device) const
+	{
+		return (this->next && this->next->device == device) ? this->next->cycle : std::numeric_limits<uint64_t>::max();
+	}
+
+	inline bool is_replay_finished () const
+	{
+		return this->is_replaying() && !this->next;
+	}
+
+private:
+	void read_next ();
+};
+
+// ---------------------------------------
+
+} // end namespace
+
+#endif
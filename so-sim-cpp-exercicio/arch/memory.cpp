@@ -1,5 +1,15 @@
+#if defined(CONFIG_TARGET_LINUX)
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+#endif
+
+#include <fstream>
+#include <iomanip>
+#include <span>
+
 #include "memory.h"
 #include "terminal.h"
+#include "cpu.h"
 
 // ---------------------------------------
 
@@ -10,25 +20,243 @@ namespace Arch {
 Memory::Memory (Computer& computer)
 	: Device(computer)
 {
-	for (auto& v: this->data)
-		v = 0;
+#if defined(CONFIG_TARGET_LINUX)
+	// anonymous mappings are zero-filled
+	void *ptr = mmap(nullptr, size_bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	mylib_assert_exception_msg(ptr != MAP_FAILED, "cannot allocate the physical memory")
+	this->data = static_cast<uint16_t*>(ptr);
+#else
+	this->data = new uint16_t[Config::phys_mem_size_words]();
+#endif
 }
 
 Memory::~Memory ()
 {
-	
+#if defined(CONFIG_TARGET_LINUX)
+	munmap(this->data, size_bytes);
+#else
+	delete[] this->data;
+#endif
+}
+
+bool Memory::map_image (const int fd, const uint64_t offset)
+{
+#if defined(CONFIG_TARGET_LINUX)
+	struct stat st;
+
+	// a mapping past the end of the file would fault on access
+	if (fstat(fd, &st) != 0 || static_cast<uint64_t>(st.st_size) < offset + size_bytes)
+		return false;
+
+	// replaces the current mapping in place, so data doesn't move
+	return mmap(this->data, size_bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, fd, offset) != MAP_FAILED;
+#else
+	return false;
+#endif
 }
 
 void Memory::run_cycle ()
 {	
 }
 
+void Memory::save_state (Lib::SnapshotWriter& out) const
+{
+	out.put_section("memory");
+
+	// so that it can be mapped straight from the file
+	out.align(Lib::snapshot_map_alignment);
+	out.put_span(std::span<const uint16_t>(this->data, Config::phys_mem_size_words));
+}
+
+void Memory::load_state (Lib::SnapshotReader& in)
+{
+	in.expect_section("memory");
+	in.align(Lib::snapshot_map_alignment);
+
+	if (in.get_fd() >= 0 && this->map_image(in.get_fd(), in.tell()))
+		in.skip(size_bytes);
+	else
+		in.get_span(std::span<uint16_t>(this->data, Config::phys_mem_size_words));
+}
+
+void Memory::save_dirty_frames (Lib::SnapshotWriter& out) const
+{
+	out.put_section("memory-dirty");
+
+	uint32_t count = 0;
+
+	for (uint32_t frame = 0; frame < nframes; frame++)
+		count += this->is_frame_dirty(frame);
+
+	out.put(count);
+
+	for (uint32_t frame = 0; frame < nframes; frame++) {
+		if (!this->is_frame_dirty(frame))
+			continue;
+
+		out.put<uint16_t>(frame);
+		out.put_span(std::span<const uint16_t>(this->data + frame * Config::page_size, Config::page_size));
+	}
+}
+
+void Memory::load_dirty_frames (Lib::SnapshotReader& in)
+{
+	in.expect_section("memory-dirty");
+
+	const uint32_t count = in.get<uint32_t>();
+
+	for (uint32_t i = 0; i < count; i++) {
+		const uint16_t frame = in.get<uint16_t>();
+		mylib_assert_exception_msg(frame < nframes, "snapshot corrupted, invalid frame ", frame)
+
+		in.get_span(std::span<uint16_t>(this->data + frame * Config::page_size, Config::page_size));
+	}
+}
+
+void Memory::add_watchpoint (const std::string_view spec)
+{
+#if defined(CONFIG_MEMORY_WATCH)
+	const auto parse_paddr = [spec] (const std::string_view str) -> uint16_t {
+		std::size_t end = 0;
+		uint32_t paddr = std::numeric_limits<uint32_t>::max();
+
+		try {
+			paddr = std::stoul(std::string(str), &end, 0);
+		}
+		catch (const std::exception&) {
+			end = 0;
+		}
+
+		mylib_assert_exception_msg(end == str.size() && paddr < Config::phys_mem_size_words, "invalid watchpoint ", spec)
+
+		return paddr;
+	};
+
+	const std::size_t colon = spec.find(':');
+	const std::string_view range = spec.substr(0, colon);
+	const std::size_t dash = range.find('-');
+
+	WatchAccess access = WatchAccess::ReadWrite;
+
+	if (colon != std::string_view::npos) {
+		const std::string_view access_str = spec.substr(colon + 1);
+
+		if (access_str == "r")
+			access = WatchAccess::Read;
+		else if (access_str == "w")
+			access = WatchAccess::Write;
+		else
+			mylib_assert_exception_msg(access_str == "rw", "invalid watchpoint ", spec)
+	}
+
+	const uint16_t first = parse_paddr(range.substr(0, dash));
+	const uint16_t last = (dash == std::string_view::npos) ? first : parse_paddr(range.substr(dash + 1));
+
+	mylib_assert_exception_msg(first <= last, "invalid watchpoint ", spec)
+
+	this->watchpoints.push_back(Watchpoint {
+		.first = first,
+		.last = last,
+		.access = access,
+		.hits = 0
+		});
+
+	this->watch_first = std::min<uint32_t>(this->watch_first, first);
+	this->watch_last = std::max<uint32_t>(this->watch_last, last);
+#else
+	mylib_throw_exception_msg("watchpoints need a build with CONFIG_MEMORY_WATCH=1, cannot watch ", spec);
+#endif
+}
+
+#if defined(CONFIG_MEMORY_WATCH)
+
+static const char* watch_access_str (const WatchAccess access)
+{
+	switch (access) {
+		using enum WatchAccess;
+
+		case Read: return "r";
+		case Write: return "w";
+		case ReadWrite: return "rw";
+	}
+
+	mylib_throw_exception_msg("invalid watch access ", std::to_underlying(access));
+}
+
+void Memory::check_watchpoints (const uint16_t paddr, const WatchAccess access, const uint16_t value)
+{
+	for (Watchpoint& watchpoint : this->watchpoints) {
+		if (paddr < watchpoint.first || paddr > watchpoint.last)
+			continue;
+
+		if ((std::to_underlying(watchpoint.access) & std::to_underlying(access)) == 0)
+			continue;
+
+		watchpoint.hits++;
+
+		const Cpu& cpu = this->computer.get_cpu();
+		const uint64_t cycle = this->computer.get_cycle();
+
+		// accesses of the kernel show the pc of the instruction that entered it
+		dprintln(this->computer, "watch ", watch_access_str(access), " paddr ", paddr, " value ", value,
+			" pc ", cpu.get_instruction_pc(), " context ", cpu.get_context_id(), " cycle ", cycle);
+
+		this->computer.get_event_trace().instant(cycle, TraceTrack::Cpu, (access == WatchAccess::Read) ? "watch read" : "watch write", "watch", "paddr", paddr);
+
+		// one line per access, even if more watchpoints cover it
+		return;
+	}
+}
+
+#endif
+
+void Memory::write_heatmap (std::ostream& out) const
+{
+#if defined(CONFIG_MEMORY_WATCH)
+	out << "heatmap: reads and writes per page frame of " << Config::page_size << " words, frames never accessed are left out" << '\n';
+	out << std::setw(7) << "frame" << std::setw(8) << "paddr" << std::setw(14) << "reads" << std::setw(14) << "writes" << '\n';
+
+	for (uint32_t frame = 0; frame < nframes; frame++) {
+		if (this->frame_reads[frame] == 0 && this->frame_writes[frame] == 0)
+			continue;
+
+		out << std::setw(7) << frame
+			<< std::setw(8) << (frame * Config::page_size)
+			<< std::setw(14) << this->frame_reads[frame]
+			<< std::setw(14) << this->frame_writes[frame] << '\n';
+	}
+
+	if (this->watchpoints.empty())
+		return;
+
+	out << '\n' << "watchpoints:" << '\n';
+
+	for (const Watchpoint& watchpoint : this->watchpoints)
+		out << watchpoint.first << '-' << watchpoint.last << ':' << watch_access_str(watchpoint.access) << ' ' << watchpoint.hits << " hits" << '\n';
+#endif
+}
+
+void Memory::write_reports () const
+{
+#if defined(CONFIG_MEMORY_WATCH)
+	if (this->heatmap_report_fname.empty())
+		return;
+
+	std::ofstream file(this->heatmap_report_fname);
+	mylib_assert_exception_msg(file.is_open(), "cannot open heatmap report ", this->heatmap_report_fname)
+
+	this->write_heatmap(file);
+
+	mylib_assert_exception_msg(file.good(), "error writing heatmap report ", this->heatmap_report_fname)
+#endif
+}
+
 void Memory::dump (const uint16_t init, const uint16_t end) const
 {
-	dprintln("memory dump from paddr ", init, " to ", end);
+	dprintln(this->computer, "memory dump from paddr ", init, " to ", end);
 	for (uint16_t i = init; i < end; i++)
-		dprint(this->data[i], " ");
-	dprintln();
+		dprint(this->computer, this->data[i], " ");
+	dprintln(this->computer);
 }
 
 // ---------------------------------------
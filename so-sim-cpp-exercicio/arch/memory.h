@@ -2,6 +2,13 @@
 #define __ARQSIM_HEADER_ARCH_MEMORY_H__
 
 #include <array>
+#include <limits>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <cstdint>
 
 #include <my-lib/std.h>
 #include <my-lib/macros.h>
@@ -13,35 +20,163 @@ namespace Arch {
 
 // ---------------------------------------
 
+// accesses a watchpoint stops at, see Memory::add_watchpoint
+enum class WatchAccess : uint8_t {
+	Read         = 1,
+	Write        = 2,
+	ReadWrite    = 3,
+};
+
+/*
+	The words live in a host memory mapping. A machine restored from a
+	snapshot file maps the memory image of the file copy-on-write, so all
+	the machines restored from the same file share the host pages they
+	did not write to, instead of each one holding a copy.
+
+	The cpu and the devices access the words through read and write.
+	Every write marks its page frame as dirty, so that a checkpoint only
+	saves the frames written since the previous one.
+	Built with CONFIG_MEMORY_WATCH, these also count the reads and writes
+	of every page frame, for the heatmap report, and check the watchpoints,
+	which print every access to their range in the Arch terminal.
+	Otherwise they are plain accesses, and asking for any of it raises
+	Mylib::Exception.
+*/
+
 class Memory : public Device
 {
+public:
+	static constexpr uint32_t size_bytes = Config::phys_mem_size_words * sizeof(uint16_t);
+	static constexpr uint32_t nframes = Config::phys_mem_size_words / Config::page_size;
+
 private:
-	std::array<uint16_t, Config::phys_mem_size_words> data;
+	uint16_t *data;
+
+	// one bit per page frame, see clear_dirty_frames
+	std::array<uint64_t, (nframes + 63) / 64> dirty_frames = {};
+
+#if defined(CONFIG_MEMORY_WATCH)
+	struct Watchpoint {
+		uint16_t first; // paddr, inclusive
+		uint16_t last;
+		WatchAccess access;
+		uint64_t hits;
+	};
+
+	std::array<uint64_t, nframes> frame_reads = {};
+	std::array<uint64_t, nframes> frame_writes = {};
+
+	std::vector<Watchpoint> watchpoints;
+
+	// covers all the watchpoints, so that most accesses skip them
+	uint32_t watch_first = std::numeric_limits<uint32_t>::max();
+	uint32_t watch_last = 0;
+
+	std::string heatmap_report_fname; // empty if not wanted
+#endif
 
 public:
 	Memory (Computer& computer);
 	~Memory ();
 
+	// Replaces the contents with a private mapping of size_bytes of the file
+	// at offset, which must be aligned to the host page size.
+	// The file must not change while it is mapped.
+	// Returns false if the host can't map it, the contents are then unchanged.
+	bool map_image (const int fd, const uint64_t offset);
+
 	void run_cycle () override final;
+	void save_state (Lib::SnapshotWriter& out) const override final;
+	void load_state (Lib::SnapshotReader& in) override final;
 
 	inline uint16_t* get_raw ()
 	{
-		return this->data.data();
+		return this->data;
 	}
 
 	inline uint16_t operator[] (const uint32_t paddr) const
 	{
-		mylib_assert_exception(paddr < this->data.size())
+		mylib_assert_exception(paddr < Config::phys_mem_size_words)
 		return this->data[paddr];
 	}
 
 	inline uint16_t& operator[] (const uint32_t paddr)
 	{
-		mylib_assert_exception(paddr < this->data.size())
+		mylib_assert_exception(paddr < Config::phys_mem_size_words)
 		return this->data[paddr];
 	}
 
+	inline uint16_t read (const uint16_t paddr)
+	{
+		const uint16_t value = (*this)[paddr];
+
+#if defined(CONFIG_MEMORY_WATCH)
+		this->frame_reads[paddr / Config::page_size]++;
+
+		if (paddr >= this->watch_first && paddr <= this->watch_last) [[unlikely]]
+			this->check_watchpoints(paddr, WatchAccess::Read, value);
+#endif
+
+		return value;
+	}
+
+	inline void write (const uint16_t paddr, const uint16_t value)
+	{
+		(*this)[paddr] = value;
+
+		const uint32_t frame = paddr / Config::page_size;
+		this->dirty_frames[frame / 64] |= uint64_t(1) << (frame % 64);
+
+#if defined(CONFIG_MEMORY_WATCH)
+		this->frame_writes[frame]++;
+
+		if (paddr >= this->watch_first && paddr <= this->watch_last) [[unlikely]]
+			this->check_watchpoints(paddr, WatchAccess::Write, value);
+#endif
+	}
+
+	inline bool is_frame_dirty (const uint32_t frame) const
+	{
+		return (this->dirty_frames[frame / 64] >> (frame % 64)) & 1;
+	}
+
+	// the frames written from now on become dirty
+	inline void clear_dirty_frames ()
+	{
+		this->dirty_frames.fill(0);
+	}
+
+	// Only the dirty frames, to be loaded over the contents the
+	// memory had when they were cleared.
+	void save_dirty_frames (Lib::SnapshotWriter& out) const;
+	void load_dirty_frames (Lib::SnapshotReader& in);
+
+	// "first[-last][:r|w|rw]", paddrs in decimal or 0x hex, rw by default.
+	// Raises Mylib::Exception if invalid.
+	void add_watchpoint (const std::string_view spec);
+
+	inline void set_heatmap_report (const std::string_view fname)
+	{
+#if defined(CONFIG_MEMORY_WATCH)
+		this->heatmap_report_fname = fname;
+#else
+		mylib_throw_exception_msg("heatmap needs a build with CONFIG_MEMORY_WATCH=1, cannot write ", fname);
+#endif
+	}
+
+	// reads and writes per page frame, then the hits of each watchpoint
+	void write_heatmap (std::ostream& out) const;
+
+	// The heatmap, if asked for. Called when the machine stops,
+	// raises Mylib::Exception in case of error.
+	void write_reports () const;
+
 	void dump (const uint16_t init = 0, const uint16_t end = Config::phys_mem_size_words-1) const;
+
+private:
+#if defined(CONFIG_MEMORY_WATCH)
+	void check_watchpoints (const uint16_t paddr, const WatchAccess access, const uint16_t value);
+#endif
 };
 
 // ---------------------------------------
@@ -0,0 +1,168 @@
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <vector>
+
+#include "profiler.h"
+
+// ---------------------------------------
+
+namespace Arch {
+
+// ---------------------------------------
+
+Profiler::Profiler (const uint32_t interval, const std::string_view report_fname, const std::string_view map_fname)
+	: interval(interval), countdown(interval), report_fname(report_fname)
+{
+	mylib_assert_exception_msg(interval > 0, "profiler interval must not be 0")
+
+	if (!map_fname.empty())
+		this->load_map(map_fname);
+}
+
+void Profiler::load_map (const std::string_view fname)
+{
+	std::ifstream file(fname.data());
+	mylib_assert_exception_msg(file.is_open(), "cannot open map file ", fname)
+
+	std::string line;
+
+	for (uint32_t nline = 1; std::getline(file, line); nline++) {
+		line = line.substr(0, line.find('#'));
+
+		std::istringstream words(line);
+		std::string addr_str, name;
+
+		if (!(words >> addr_str))
+			continue;
+
+		mylib_assert_exception_msg(words >> name, "map file ", fname, " line ", nline, ": missing symbol name")
+
+		std::size_t end;
+		uint32_t addr;
+
+		try {
+			addr = std::stoul(addr_str, &end, 0);
+		}
+		catch (const std::exception&) {
+			end = 0;
+		}
+
+		mylib_assert_exception_msg(end == addr_str.size() && addr <= 0xFFFF, "map file ", fname, " line ", nline, ": invalid address ", addr_str)
+
+		this->symbols[addr] = name;
+	}
+}
+
+void Profiler::skip_cycles (const uint64_t ncycles)
+{
+	const uint64_t elapsed = (this->interval - this->countdown) + ncycles;
+
+	this->idle_samples += elapsed / this->interval;
+	this->countdown = this->interval - (elapsed % this->interval);
+}
+
+std::string Profiler::get_symbol_str (const uint16_t pc, const bool offset) const
+{
+	auto it = this->symbols.upper_bound(pc);
+
+	if (it == this->symbols.begin())
+		return Mylib::build_str_from_stream(pc);
+
+	--it;
+
+	if (!offset || it->first == pc)
+		return it->second;
+
+	return Mylib::build_str_from_stream(it->second, '+', pc - it->first);
+}
+
+void Profiler::write_report (std::ostream& out) const
+{
+	struct Entry {
+		std::string name;
+		uint16_t context_id;
+		uint64_t samples;
+	};
+
+	uint64_t total = this->idle_samples;
+
+	for (const auto& [key, count] : this->samples)
+		total += count;
+
+	const auto sort_entries = [] (std::vector<Entry>& entries) {
+		std::ranges::sort(entries, [] (const Entry& a, const Entry& b) {
+			return (a.samples != b.samples) ? (a.samples > b.samples) : (a.name < b.name);
+		});
+	};
+
+	const auto print_entries = [&out, total] (const std::vector<Entry>& entries) {
+		out << std::setw(10) << "samples" << std::setw(8) << "%" << std::setw(7) << "pid" << "  " << "where" << '\n';
+
+		for (const Entry& entry : entries) {
+			out << std::setw(10) << entry.samples
+				<< std::setw(8) << std::fixed << std::setprecision(2) << (100.0 * entry.samples / total)
+				<< std::setw(7) << entry.context_id
+				<< "  " << entry.name << '\n';
+		}
+	};
+
+	out << "profile: " << total << " samples, one every " << this->interval << " cycles, "
+		<< this->idle_samples << " idle" << '\n';
+
+	if (total == 0)
+		return;
+
+	// per symbol, all addresses without a symbol together
+
+	std::map<std::pair<uint16_t, std::string>, uint64_t> by_symbol;
+
+	for (const auto& [key, count] : this->samples) {
+		const uint16_t pc = key & 0xFFFF;
+		const bool has_symbol = !this->symbols.empty() && this->symbols.begin()->first <= pc;
+
+		by_symbol[{ static_cast<uint16_t>(key >> 16), has_symbol ? this->get_symbol_str(pc, false) : "?" }] += count;
+	}
+
+	std::vector<Entry> entries;
+
+	for (const auto& [key, count] : by_symbol)
+		entries.push_back(Entry { .name = key.second, .context_id = key.first, .samples = count });
+
+	sort_entries(entries);
+
+	out << '\n' << "by symbol:" << '\n';
+	print_entries(entries);
+
+	entries.clear();
+
+	for (const auto& [key, count] : this->samples) {
+		const uint16_t pc = key & 0xFFFF;
+		std::string name = Mylib::build_str_from_stream(pc);
+
+		if (!this->symbols.empty() && this->symbols.begin()->first <= pc)
+			name += " " + this->get_symbol_str(pc, true);
+
+		entries.push_back(Entry { .name = std::move(name), .context_id = static_cast<uint16_t>(key >> 16), .samples = count });
+	}
+
+	sort_entries(entries);
+
+	out << '\n' << "by address:" << '\n';
+	print_entries(entries);
+}
+
+void Profiler::write_report () const
+{
+	std::ofstream file(this->report_fname);
+	mylib_assert_exception_msg(file.is_open(), "cannot open profile report ", this->report_fname)
+
+	this->write_report(file);
+
+	mylib_assert_exception_msg(file.good(), "error writing profile report ", this->report_fname)
+}
+
+// ---------------------------------------
+
+} // end namespace
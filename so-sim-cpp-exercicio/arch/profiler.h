@@ -0,0 +1,79 @@
+#ifndef __ARQSIM_HEADER_ARCH_PROFILER_H__
+#define __ARQSIM_HEADER_ARCH_PROFILER_H__
+
+#include <map>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+#include <cstdint>
+
+#include <my-lib/std.h>
+#include <my-lib/macros.h>
+
+namespace Arch {
+
+// ---------------------------------------
+
+/*
+	Sampling profiler of the guest, driven by the cpu.
+	Every interval cycles it counts the pc being executed, together with
+	the context id the OS set (the pid of the running process), or an
+	idle sample if the cpu is halted.
+
+	Symbols come from an optional map file, one "address name" per line,
+	the address in decimal or 0x hex, # starts a comment. A pc belongs
+	to the symbol with the highest address not above it.
+*/
+
+class Profiler
+{
+private:
+	uint32_t interval;
+	uint32_t countdown; // cycles until the next sample, 1 to interval
+
+	std::unordered_map<uint32_t, uint64_t> samples; // by (context id << 16) | pc
+	uint64_t idle_samples = 0;
+
+	std::map<uint16_t, std::string> symbols; // by address
+
+	std::string report_fname;
+
+public:
+	// raises Mylib::Exception if the map file cannot be read
+	Profiler (const uint32_t interval, const std::string_view report_fname, const std::string_view map_fname = "");
+
+	inline void run_cycle (const bool halted, const uint16_t context_id, const uint16_t pc)
+	{
+		if (--this->countdown == 0) {
+			this->countdown = this->interval;
+
+			if (halted)
+				this->idle_samples++;
+			else
+				this->samples[(static_cast<uint32_t>(context_id) << 16) | pc]++;
+		}
+	}
+
+	// the cpu is halted while cycles are skipped
+	void skip_cycles (const uint64_t ncycles);
+
+	// per symbol and per address, most sampled first
+	void write_report (std::ostream& out) const;
+
+	// to report_fname, raises Mylib::Exception in case of error
+	void write_report () const;
+
+private:
+	void load_map (const std::string_view fname);
+
+	// name+offset, or just the address if no symbol covers it
+	std::string get_symbol_str (const uint16_t pc, const bool offset) const;
+};
+
+// ---------------------------------------
+
+} // end namespace
+
+#endif
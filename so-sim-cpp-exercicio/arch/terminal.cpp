@@ -1,6 +1,11 @@
+#include <algorithm>
+#include <fstream>
+#include <limits>
+
 #include "terminal.h"
 #include "computer.h"
 #include "cpu.h"
+#include "memory.h"
  
 // ---------------------------------------
 
@@ -27,6 +32,17 @@ VideoOutput::VideoOutput (const uint32_t xinit, const uint32_t xend, const uint3
 	this->update();
 }
 
+VideoOutput::VideoOutput (const uint32_t nrows, const uint32_t ncols)
+{
+	this->buffer = MatrixBuffer(nrows, ncols);
+	this->buffer.set_all(' ');
+
+	this->x = 0;
+	this->y = 0;
+
+	this->win = nullptr;
+}
+
 VideoOutput::~VideoOutput ()
 {
 
@@ -94,6 +110,9 @@ void VideoOutput::roll ()
 
 void VideoOutput::update ()
 {
+	if (this->win == nullptr)
+		return;
+
 	const auto nrows = this->buffer.get_nrows();
 	const auto ncols = this->buffer.get_ncols();
 
@@ -118,31 +137,69 @@ void VideoOutput::dump () const
 	}
 }
 
+std::string VideoOutput::get_text () const
+{
+	const auto nrows = this->buffer.get_nrows();
+	const auto ncols = this->buffer.get_ncols();
+
+	std::string text;
+	std::size_t used = 0; // up to the last non-empty line
+
+	for (uint32_t row = 0; row < nrows; row++) {
+		uint32_t len = ncols;
+
+		while (len > 0 && this->buffer[row, len-1] == ' ')
+			len--;
+
+		for (uint32_t col = 0; col < len; col++)
+			text.push_back(this->buffer[row, col]);
+
+		if (len > 0)
+			used = text.size();
+
+		text.push_back('\n');
+	}
+
+	text.resize(used);
+
+	return text;
+}
+
 // ---------------------------------------
 
-Terminal::Terminal (Computer& computer)
-	: IO_Device(computer)
+Terminal::Terminal (Computer& computer, const bool headless)
+	: IO_Device(computer), headless(headless)
 {
-	const uint32_t total_w = COLS;
-	const uint32_t total_h = LINES;
-
 	this->videos.reserve( std::to_underlying(Type::Count) );
 
-	// arch video
-	this->videos.emplace_back(1, total_w/3, 1, total_h);
+	if (headless) {
+		for (uint16_t i = 0; i < std::to_underlying(Type::Count); i++)
+			this->videos.emplace_back(Config::terminal_headless_rows, Config::terminal_headless_cols);
+	}
+	else {
+		const uint32_t total_w = COLS;
+		const uint32_t total_h = LINES;
+
+		// arch video
+		this->videos.emplace_back(1, total_w/3, 1, total_h);
 
-	// kernel video
-	this->videos.emplace_back(total_w/3 + 1, 2*(total_w/3), 1, total_h/2);
+		// kernel video
+		this->videos.emplace_back(total_w/3 + 1, 2*(total_w/3), 1, total_h/2);
 
-	// command video
-	this->videos.emplace_back(total_w/3 + 1, 2*(total_w/3), total_h/2 + 1, total_h);
+		// command video
+		this->videos.emplace_back(total_w/3 + 1, 2*(total_w/3), total_h/2 + 1, total_h);
 
-	// app video
-	this->videos.emplace_back(2*(total_w/3) + 1, total_w, 1, total_h);
+		// app video
+		this->videos.emplace_back(2*(total_w/3) + 1, total_w, 1, total_h);
+	}
 
 	this->computer.set_io_port(IO_Port::TerminalSet, this);
 	this->computer.set_io_port(IO_Port::TerminalUpload, this);
 	this->computer.set_io_port(IO_Port::TerminalReadTypedChar, this);
+	this->computer.set_io_port(IO_Port::TerminalTypedCount, this);
+	this->computer.set_io_port(IO_Port::TerminalDmaAddr, this);
+	this->computer.set_io_port(IO_Port::TerminalDmaRead, this);
+	this->computer.set_io_port(IO_Port::TerminalReadCommandChar, this);
 }
 
 Terminal::~Terminal ()
@@ -151,21 +208,213 @@ Terminal::~Terminal ()
 
 void Terminal::run_cycle ()
 {
-	const int typed = getch();
+	InputLog& log = this->computer.get_input_log();
 
-	if (typed != ERR) {
-		this->has_char = true;
+	if (log.is_replaying()) {
+		while (const auto key = log.replay(this->computer.get_cycle(), InputDevice::Terminal))
+			this->push_key(*key);
+	}
+	else if (this->input_thread.joinable()) {
+		// while the buffer of a key is full, it waits in script_chars
+		while (const auto key = this->script_chars.peek()) {
+			if (!this->can_push_key(*key))
+				break;
+
+			this->script_chars.pop();
+			this->type_key(*key);
+		}
+	}
+	// while the buffer is full, keys stay queued in ncurses
+	else if (!this->headless && !this->typed_chars.full()) {
+		const int typed = getch();
+
+		if (typed != ERR) {
+			if (typed == KEY_BACKSPACE || typed == 127) // || '\b'
+				this->type_key(8);
+			else
+				this->type_key(typed);
+		}
+	}
 
-		if (typed == KEY_BACKSPACE || typed == 127) // || '\b'
-			this->typed_char = 8;
-		else
-			this->typed_char = typed;
+	if (!this->keyboard_notified && !this->typed_chars.empty()) {
+		this->computer.get_cpu().interrupt(InterruptCode::Keyboard);
+		this->keyboard_notified = true;
 	}
 
-	if (this->has_char)
+	if (!this->command_chars.empty())
 		this->computer.get_cpu().interrupt(InterruptCode::Keyboard);
 }
 
+uint64_t Terminal::get_idle_cycles () const
+{
+	// keys already typed still have to raise the Keyboard interrupt
+	if ((!this->keyboard_notified && !this->typed_chars.empty()) || !this->command_chars.empty())
+		return 0;
+
+	const InputLog& log = this->computer.get_input_log();
+
+	if (log.is_replaying()) {
+		const uint64_t next = log.get_next_cycle(InputDevice::Terminal);
+		const uint64_t cycle = this->computer.get_cycle();
+
+		if (next == std::numeric_limits<uint64_t>::max())
+			return next;
+
+		// an earlier one is a divergence, raised by run_cycle
+		return (next > cycle) ? (next - cycle) : 0;
+	}
+
+	if (const auto key = this->script_chars.peek(); key && this->can_push_key(*key))
+		return 0;
+
+	return std::numeric_limits<uint64_t>::max();
+}
+
+bool Terminal::is_input_closed () const
+{
+	if (!this->headless)
+		return false;
+
+	if (this->computer.get_input_log().is_replaying())
+		return this->computer.get_input_log().is_replay_finished();
+
+	return !this->input_thread.joinable() || (this->input_script_done && this->script_chars.empty());
+}
+
+template <typename Buffer>
+static void save_keys (Lib::SnapshotWriter& out, const Buffer& keys)
+{
+	std::vector<uint16_t> data(keys.size());
+	data.resize(keys.peek(data));
+	out.put_vector(data);
+}
+
+template <typename Buffer>
+static void load_keys (Lib::SnapshotReader& in, Buffer& keys)
+{
+	while (keys.pop()) { }
+
+	const auto data = in.get_vector<uint16_t>();
+	mylib_assert_exception(keys.push(data) == data.size())
+}
+
+void Terminal::save_state (Lib::SnapshotWriter& out) const
+{
+	out.put_section("terminal");
+	out.put(this->dma_addr);
+	out.put(this->dma_amount);
+	out.put(this->current_video);
+	out.put(this->input_focus);
+	save_keys(out, this->typed_chars);
+	save_keys(out, this->command_chars);
+}
+
+void Terminal::load_state (Lib::SnapshotReader& in)
+{
+	in.expect_section("terminal");
+	this->dma_addr = in.get<uint16_t>();
+	this->dma_amount = in.get<uint16_t>();
+	this->current_video = in.get<Type>();
+	this->input_focus = in.get<Type>();
+	load_keys(in, this->typed_chars);
+	load_keys(in, this->command_chars);
+
+	// the interrupt is raised as soon as keys are typed, and is pending in the cpu
+	this->keyboard_notified = !this->typed_chars.empty();
+}
+
+bool Terminal::push_key (const uint16_t key)
+{
+	if (key == Config::terminal_focus_key) {
+		this->input_focus = (this->input_focus == Type::App) ? Type::Command : Type::App;
+		return true;
+	}
+
+	if (this->input_focus == Type::Command)
+		return this->command_chars.push(key);
+	else
+		return this->typed_chars.push(key);
+}
+
+bool Terminal::can_push_key (const uint16_t key) const
+{
+	if (key == Config::terminal_focus_key)
+		return true;
+
+	if (this->input_focus == Type::Command)
+		return !this->command_chars.full();
+	else
+		return !this->typed_chars.full();
+}
+
+void Terminal::type_key (const uint16_t key)
+{
+	this->computer.get_input_log().record(this->computer.get_cycle(), InputDevice::Terminal, key);
+	this->push_key(key);
+}
+
+void Terminal::set_input_script (const std::string_view fname)
+{
+	std::ifstream file(fname.data(), std::ios::binary);
+
+	if (!file.is_open())
+		throw Mylib::Exception(Mylib::build_str_from_stream("cannot open input script ", fname));
+
+	std::vector<uint16_t> keys;
+
+	for (char c; file.get(c); )
+		keys.push_back(static_cast<uint8_t>(c));
+
+	this->input_thread = std::jthread([this, keys = std::move(keys)] (std::stop_token stop) {
+		std::span<const uint16_t> pending(keys);
+
+		while (!pending.empty() && !stop.stop_requested()) {
+			const uint32_t n = this->script_chars.push(pending);
+
+			pending = pending.subspan(n);
+
+			if (n == 0)
+				std::this_thread::yield();
+		}
+
+		this->input_script_done = pending.empty();
+	});
+}
+
+uint16_t Terminal::pop_typed_char ()
+{
+	const auto c = this->typed_chars.pop();
+
+	if (this->typed_chars.empty())
+		this->keyboard_notified = false;
+
+	return c.value_or(0);
+}
+
+uint16_t Terminal::dma_typed_chars (const uint16_t max)
+{
+	std::array<uint16_t, 64> chunk;
+	Memory& memory = this->computer.get_memory();
+	uint16_t amount = 0;
+
+	while (amount < max) {
+		const uint32_t n = this->typed_chars.pop(std::span(chunk).first(std::min<uint32_t>(chunk.size(), max - amount)));
+
+		if (n == 0)
+			break;
+
+		for (uint32_t i = 0; i < n; i++)
+			memory.write(this->dma_addr + amount + i, chunk[i]);
+
+		amount += n;
+	}
+
+	if (this->typed_chars.empty())
+		this->keyboard_notified = false;
+
+	return amount;
+}
+
 uint16_t Terminal::read (const uint16_t port)
 {
 	const IO_Port port_enum = static_cast<IO_Port>(port);
@@ -179,8 +428,19 @@ uint16_t Terminal::read (const uint16_t port)
 		break;
 		
 		case TerminalReadTypedChar:
-			this->has_char = false;
-			r = this->typed_char;
+			r = this->pop_typed_char();
+		break;
+
+		case TerminalTypedCount:
+			r = this->typed_chars.size();
+		break;
+
+		case TerminalDmaRead:
+			r = this->dma_amount;
+		break;
+
+		case TerminalReadCommandChar:
+			r = this->command_chars.pop().value_or(0);
 		break;
 
 		default:
@@ -207,6 +467,15 @@ void Terminal::write (const uint16_t port, const uint16_t value)
 		}
 		break;
 
+		case TerminalDmaAddr:
+			this->dma_addr = value;
+		break;
+
+		// copies up to value typed chars to physical memory at dma_addr
+		case TerminalDmaRead:
+			this->dma_amount = this->dma_typed_chars(value);
+		break;
+
 		default:
 			mylib_throw_exception_msg("Terminal write invalid port ", port);
 	}
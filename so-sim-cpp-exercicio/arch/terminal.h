@@ -9,7 +9,11 @@
 	#error Untested platform
 #endif
 
+#include <atomic>
+#include <ostream>
 #include <string>
+#include <string_view>
+#include <thread>
 #include <vector>
 
 #include <my-lib/std.h>
@@ -19,6 +23,7 @@
 #include "device.h"
 #include "computer.h"
 #include "../config.h"
+#include "../ring-buffer.h"
 
 namespace Arch {
 
@@ -29,7 +34,7 @@ class VideoOutput
 private:
 	using MatrixBuffer = Mylib::Matrix<char, true>;
 
-	WINDOW *win;
+	WINDOW *win; // nullptr when headless
 
 	MatrixBuffer buffer;
 
@@ -39,11 +44,18 @@ private:
 
 public:
 	VideoOutput (const uint32_t xinit, const uint32_t xend, const uint32_t yinit, const uint32_t yend);
+
+	// headless, only kept in the buffer
+	VideoOutput (const uint32_t nrows, const uint32_t ncols);
+
 	~VideoOutput ();
 
 	void print (const std::string_view str);
 	void dump () const;
 
+	// lines without trailing spaces, up to the last non-empty one
+	std::string get_text () const;
+
 private:
 	void roll ();
 	void update ();
@@ -64,19 +76,57 @@ public:
 	};
 
 private:
+	// Headless terminals don't use ncurses at all, so many machines
+	// can run in the same process. Their only keys are the input script
+	// or a replayed input log.
+	const bool headless;
+
 	std::vector<VideoOutput> videos;
-	uint16_t typed_char;
-	bool has_char = false;
+
+	// Typed keys, filled at run_cycle from ncurses, the input script
+	// or the input log, and consumed through the IO ports.
+	Lib::SpscRingBuffer<uint16_t, Config::terminal_input_buffer_size> typed_chars;
+
+	// Keys typed while the command terminal has the keyboard,
+	// the OS reads all of them at every Keyboard interrupt.
+	Lib::SpscRingBuffer<uint16_t, Config::terminal_command_buffer_size> command_chars;
+
+	// Keyboard was raised and the OS did not empty typed_chars yet.
+	// Only the first key of a burst raises an interrupt.
+	bool keyboard_notified = false;
+
+	// toggled by Config::terminal_focus_key
+	Type input_focus = Type::App;
+
+	// Keys of the input script not typed yet. They are typed at run_cycle,
+	// so the cycle each key enters the machine can be recorded.
+	Lib::SpscRingBuffer<uint16_t, Config::terminal_input_buffer_size> script_chars;
+
+	// set by input_thread, so it must be destroyed after it
+	std::atomic<bool> input_script_done = false;
+
+	// when set, keys come from input_thread instead of ncurses
+	std::jthread input_thread;
+
+	uint16_t dma_addr = 0;
+	uint16_t dma_amount = 0;
+
 	Type current_video = Type::Arch;
 
 public:
-	Terminal (Computer& computer);
+	Terminal (Computer& computer, const bool headless);
 	~Terminal ();
 
 	void run_cycle () override final;
+	uint64_t get_idle_cycles () const override final;
 	uint16_t read (const uint16_t port) override final;
 	void write (const uint16_t port, const uint16_t value) override final;
 
+	// Keys typed and not read yet, the screens and the keyboard
+	// focus belong to the user, not to the machine, so they are not saved.
+	void save_state (Lib::SnapshotWriter& out) const override final;
+	void load_state (Lib::SnapshotReader& in) override final;
+
 	void dump (const Type video) const
 	{
 		this->videos[ std::to_underlying(video) ].dump();
@@ -86,21 +136,51 @@ public:
 	{
 		this->videos[ std::to_underlying(video) ].print(str);
 	}
+
+	std::string get_text (const Type video) const
+	{
+		return this->videos[ std::to_underlying(video) ].get_text();
+	}
+
+	inline bool is_headless () const
+	{
+		return this->headless;
+	}
+
+	// true when no key will ever be typed again,
+	// only possible for headless terminals
+	bool is_input_closed () const;
+
+	// Feeds the keys of the file to the guest as fast as it reads them,
+	// instead of reading the keyboard.
+	// raises Mylib::Exception if the file cannot be opened
+	void set_input_script (const std::string_view fname);
+
+private:
+	// returns false if the key was dropped because its buffer is full
+	bool push_key (const uint16_t key);
+	bool can_push_key (const uint16_t key) const;
+
+	// a key from the host, recorded in the input log
+	void type_key (const uint16_t key);
+
+	uint16_t pop_typed_char ();
+	uint16_t dma_typed_chars (const uint16_t max);
 };
 
 // ---------------------------------------
 
 template <typename... Types>
-void dprint (Types&&... vars)
+void dprint (Computer& computer, Types&&... vars)
 {
 	const std::string str = Mylib::build_str_from_stream(vars...);
-	Computer::get().get_terminal().print_str(Terminal::Type::Arch, str);
+	computer.get_terminal().print_str(Terminal::Type::Arch, str);
 }
 
 template <typename... Types>
-void dprintln (Types&&... vars)
+void dprintln (Computer& computer, Types&&... vars)
 {
-	dprint(vars..., '\n');
+	dprint(computer, vars..., '\n');
 }
 
 // ---------------------------------------
@@ -1,4 +1,6 @@
+#include <algorithm>
 #include <chrono>
+#include <limits>
 
 #include "timer.h"
 #include "computer.h"
@@ -13,8 +15,6 @@ namespace Arch {
 
 using Clock = std::chrono::steady_clock;
 
-static const auto start_time = Clock::now();
-
 // ---------------------------------------
 
 Timer::Timer (Computer& computer)
@@ -22,16 +22,111 @@ Timer::Timer (Computer& computer)
 {
 	this->computer.set_io_port(IO_Port::TimerInterruptCycles, this);
 	this->computer.set_io_port(IO_Port::TimerGetTimeSeconds, this);
+	this->computer.set_io_port(IO_Port::TimerChannelSelect, this);
+	this->computer.set_io_port(IO_Port::TimerChannelMode, this);
+	this->computer.set_io_port(IO_Port::TimerChannelCycles0, this);
+	this->computer.set_io_port(IO_Port::TimerChannelCycles1, this);
+	this->computer.set_io_port(IO_Port::TimerFiredChannels, this);
+
+	for (uint16_t i = 0; i < 4; i++) {
+		this->computer.set_io_port(std::to_underlying(IO_Port::TimerCycles0) + i, this);
+		this->computer.set_io_port(std::to_underlying(IO_Port::TimerTimeUs0) + i, this);
+	}
+
+	this->channels[0].mode = TimerMode::Periodic;
+	this->channels[0].interval = Config::timer_default_interrupt_cycles;
 }
 
 void Timer::run_cycle ()
 {
-	if (this->count >= this->timer_interrupt_cycles) {
-		if (this->computer.get_cpu().interrupt(InterruptCode::Timer))
-			this->count = 0;
+	this->cycles++;
+
+	for (uint16_t i = 0; i < this->channels.size(); i++) {
+		Channel& channel = this->channels[i];
+
+		if (channel.mode == TimerMode::Off)
+			continue;
+
+		channel.count++;
+
+		if (channel.count >= channel.interval) {
+			channel.count = 0;
+
+			if (channel.mode == TimerMode::OneShot)
+				channel.mode = TimerMode::Off;
+
+			this->fired |= 1 << i;
+			this->computer.get_cpu().interrupt(InterruptCode::Timer);
+		}
 	}
-	else
-		this->count++;
+}
+
+uint64_t Timer::get_idle_cycles () const
+{
+	uint64_t idle = std::numeric_limits<uint64_t>::max();
+
+	// the cycle that makes count reach the interval can't be skipped
+	for (const Channel& channel : this->channels) {
+		if (channel.mode == TimerMode::Off)
+			continue;
+
+		if (channel.count + 1 >= channel.interval)
+			return 0;
+
+		idle = std::min<uint64_t>(idle, channel.interval - channel.count - 1);
+	}
+
+	return idle;
+}
+
+void Timer::skip_cycles (const uint64_t ncycles)
+{
+	mylib_assert_exception(ncycles <= this->get_idle_cycles())
+
+	for (Channel& channel : this->channels) {
+		if (channel.mode != TimerMode::Off)
+			channel.count += ncycles;
+	}
+
+	this->cycles += ncycles;
+}
+
+void Timer::save_state (Lib::SnapshotWriter& out) const
+{
+	out.put_section("timer");
+	out.put(this->channels);
+	out.put(this->selected);
+	out.put(this->fired);
+	out.put(this->cycles);
+	out.put(this->latched_cycles);
+	out.put(this->latched_time_us);
+	out.put<int64_t>(std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - this->start_time).count());
+}
+
+void Timer::load_state (Lib::SnapshotReader& in)
+{
+	in.expect_section("timer");
+	this->channels = in.get<decltype(this->channels)>();
+	this->selected = in.get<uint16_t>();
+	this->fired = in.get<uint16_t>();
+	this->cycles = in.get<uint64_t>();
+	this->latched_cycles = in.get<uint64_t>();
+	this->latched_time_us = in.get<uint64_t>();
+	this->start_time = Clock::now() - std::chrono::microseconds(in.get<int64_t>());
+}
+
+uint64_t Timer::read_host_time_us ()
+{
+	InputLog& log = this->computer.get_input_log();
+	const uint64_t cycle = this->computer.get_cycle();
+
+	if (log.is_replaying())
+		return log.replay_expected(cycle, InputDevice::Timer);
+
+	const uint64_t us = std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - this->start_time).count();
+	log.record(cycle, InputDevice::Timer, us);
+
+	return us;
 }
 
 uint16_t Timer::read (const uint16_t port)
@@ -43,13 +138,50 @@ uint16_t Timer::read (const uint16_t port)
 		using enum IO_Port;
 
 		case TimerInterruptCycles:
-			r = this->timer_interrupt_cycles;
+			r = this->channels[0].interval;
+		break;
+
+		case TimerChannelSelect:
+			r = this->selected;
+		break;
+
+		case TimerChannelMode:
+			r = std::to_underlying(this->channels[this->selected].mode);
+		break;
+
+		case TimerChannelCycles0:
+			r = this->channels[this->selected].interval & 0xFFFF;
+		break;
+
+		case TimerChannelCycles1:
+			r = this->channels[this->selected].interval >> 16;
+		break;
+
+		case TimerFiredChannels:
+			r = this->fired;
+			this->fired = 0;
 		break;
 
 		case TimerGetTimeSeconds:
-			r = std::chrono::duration_cast<std::chrono::seconds>(
-				Clock::now() - start_time
-			).count();
+			r = this->read_host_time_us() / 1'000'000;
+		break;
+
+		case TimerCycles0:
+			this->latched_cycles = this->cycles;
+			[[fallthrough]];
+		case TimerCycles1:
+		case TimerCycles2:
+		case TimerCycles3:
+			r = this->latched_cycles >> (16 * (port - std::to_underlying(TimerCycles0)));
+		break;
+
+		case TimerTimeUs0:
+			this->latched_time_us = this->read_host_time_us();
+			[[fallthrough]];
+		case TimerTimeUs1:
+		case TimerTimeUs2:
+		case TimerTimeUs3:
+			r = this->latched_time_us >> (16 * (port - std::to_underlying(TimerTimeUs0)));
 		break;
 
 		default:
@@ -67,7 +199,29 @@ void Timer::write (const uint16_t port, const uint16_t value)
 		using enum IO_Port;
 
 		case TimerInterruptCycles:
-			this->timer_interrupt_cycles = value;
+			this->channels[0].interval = value;
+		break;
+
+		case TimerChannelSelect:
+			mylib_assert_exception_msg(value < this->channels.size(), "invalid timer channel ", value)
+			this->selected = value;
+		break;
+
+		case TimerChannelMode: {
+			mylib_assert_exception_msg(value <= std::to_underlying(TimerMode::Periodic), "invalid timer mode ", value)
+
+			Channel& channel = this->channels[this->selected];
+			channel.mode = static_cast<TimerMode>(value);
+			channel.count = 0;
+		}
+		break;
+
+		case TimerChannelCycles0:
+			this->channels[this->selected].interval = (this->channels[this->selected].interval & 0xFFFF0000) | value;
+		break;
+
+		case TimerChannelCycles1:
+			this->channels[this->selected].interval = (this->channels[this->selected].interval & 0xFFFF) | (static_cast<uint32_t>(value) << 16);
 		break;
 
 		default:
@@ -1,6 +1,9 @@
 #ifndef __ARQSIM_HEADER_ARCH_TIMER_H__
 #define __ARQSIM_HEADER_ARCH_TIMER_H__
 
+#include <array>
+#include <chrono>
+
 #include <cstdint>
 
 #include <my-lib/std.h>
@@ -13,18 +16,64 @@ namespace Arch {
 
 // ---------------------------------------
 
+enum class TimerMode : uint16_t {
+	Off       = 0,
+	OneShot   = 1, // fires once and turns itself off
+	Periodic  = 2,
+};
+
+// ---------------------------------------
+
+/*
+	Independent channels share the Timer interrupt, the handler
+	reads TimerFiredChannels to know which ones fired.
+	A channel fires when it has counted its interval of cycles.
+*/
+
 class Timer : public IO_Device
 {
+public:
+	struct Channel {
+		TimerMode mode = TimerMode::Off;
+		uint32_t interval = 0;
+		uint32_t count = 0;
+	};
+
 private:
-	uint16_t count = 0;
-	uint16_t timer_interrupt_cycles = Config::timer_default_interrupt_cycles;
+	std::array<Channel, Config::timer_channels> channels;
+	uint16_t selected = 0;
+	uint16_t fired = 0; // bitmask
+
+	uint64_t cycles = 0; // since power on
+
+	// host time at power on, moved when a snapshot is restored
+	// so that the guest sees its clock continue
+	std::chrono::steady_clock::time_point start_time = std::chrono::steady_clock::now();
+
+	// 64-bit values are read in 16-bit words,
+	// latched when word 0 is read so they are consistent
+	uint64_t latched_cycles = 0;
+	uint64_t latched_time_us = 0;
 
 public:
 	Timer (Computer& computer);
 
+	inline const Channel& get_channel (const uint16_t i) const
+	{
+		return this->channels[i];
+	}
+
 	void run_cycle () override final;
+	uint64_t get_idle_cycles () const override final;
+	void skip_cycles (const uint64_t ncycles) override final;
+	void save_state (Lib::SnapshotWriter& out) const override final;
+	void load_state (Lib::SnapshotReader& in) override final;
 	uint16_t read (const uint16_t port) override final;
 	void write (const uint16_t port, const uint16_t value) override final;
+
+private:
+	// the only input of the timer that comes from the host, see InputLog
+	uint64_t read_host_time_us ();
 };
 
 // ---------------------------------------
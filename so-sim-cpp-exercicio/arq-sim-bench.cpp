@@ -0,0 +1,294 @@
+#include <iostream>
+#include <fstream>
+#include <algorithm>
+#include <chrono>
+#include <exception>
+#include <filesystem>
+#include <memory>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <cstdint>
+#include <cstdlib>
+
+#include <unistd.h>
+
+#include <my-lib/std.h>
+
+#include "config.h"
+#include "arch/computer.h"
+#include "arch/terminal.h"
+#include "arch/cpu.h"
+#include "os/os.h"
+
+/*
+	Measures the simulator running canned guest programs on headless
+	machines, one at a time, and prints one JSON object per line for
+	each program, to be kept for regression tracking.
+
+	arq-sim-bench [-c cycles] [program ...]
+
+	Every program runs for the same amount of cycles (default
+	bench_default_cycles), and only the time spent in Computer::run
+	is measured. The programs and their files are written to a
+	temporary directory, which is the current directory while they run.
+*/
+
+// ---------------------------------------
+
+using Clock = std::chrono::steady_clock;
+using Cpu = Arch::Cpu;
+
+static constexpr uint64_t bench_default_cycles = 2'000'000;
+
+// guest code, see the instruction formats in Cpu::execute_r and Cpu::execute_i
+
+static constexpr uint16_t instr_r (const Cpu::OpcodeR opcode, const uint16_t dest = 0, const uint16_t op1 = 0, const uint16_t op2 = 0)
+{
+	return (std::to_underlying(opcode) << 9) | (dest << 6) | (op1 << 3) | op2;
+}
+
+static constexpr uint16_t instr_i (const Cpu::OpcodeI opcode, const uint16_t reg, const uint16_t imed)
+{
+	return 0x8000 | (std::to_underlying(opcode) << 13) | (reg << 10) | imed;
+}
+
+static constexpr uint16_t add (const uint16_t d, const uint16_t a, const uint16_t b) { return instr_r(Cpu::OpcodeR::Add, d, a, b); }
+static constexpr uint16_t sub (const uint16_t d, const uint16_t a, const uint16_t b) { return instr_r(Cpu::OpcodeR::Sub, d, a, b); }
+static constexpr uint16_t mul (const uint16_t d, const uint16_t a, const uint16_t b) { return instr_r(Cpu::OpcodeR::Mul, d, a, b); }
+static constexpr uint16_t div (const uint16_t d, const uint16_t a, const uint16_t b) { return instr_r(Cpu::OpcodeR::Div, d, a, b); }
+static constexpr uint16_t cmp_neq (const uint16_t d, const uint16_t a, const uint16_t b) { return instr_r(Cpu::OpcodeR::Cmp_neq, d, a, b); }
+static constexpr uint16_t load (const uint16_t d, const uint16_t addr) { return instr_r(Cpu::OpcodeR::Load, d, addr); }
+static constexpr uint16_t store (const uint16_t addr, const uint16_t value) { return instr_r(Cpu::OpcodeR::Store, 0, addr, value); }
+static constexpr uint16_t syscall () { return instr_r(Cpu::OpcodeR::Syscall); }
+static constexpr uint16_t jump (const uint16_t addr) { return instr_i(Cpu::OpcodeI::Jump, 0, addr); }
+static constexpr uint16_t jump_cond (const uint16_t reg, const uint16_t addr) { return instr_i(Cpu::OpcodeI::Jump_cond, reg, addr); }
+static constexpr uint16_t mov (const uint16_t reg, const uint16_t imed) { return instr_i(Cpu::OpcodeI::Mov, reg, imed); }
+
+static constexpr uint16_t sys (const OS::Syscall number)
+{
+	return std::to_underlying(number);
+}
+
+// ---------------------------------------
+
+struct File {
+	std::string fname;
+	std::vector<uint16_t> words;
+};
+
+struct Bench {
+	const char *name;
+	std::vector<File> files; // the first one is init.bin
+	std::string script; // keys for the command terminal, if any
+};
+
+// data of the programs is at data_vaddr, after the code
+static constexpr uint16_t data_vaddr = 64;
+
+static std::vector<uint16_t> build_image (const std::vector<uint16_t> code, const std::string_view data = "", const uint32_t size = 0)
+{
+	mylib_assert_exception(code.size() <= data_vaddr)
+
+	std::vector<uint16_t> words = code;
+	words.resize(data_vaddr, 0);
+
+	for (const char c : data)
+		words.push_back(c);
+
+	if (words.size() < size)
+		words.resize(size, 0);
+
+	return words;
+}
+
+static const std::vector<uint16_t> exit_program = build_image({
+	mov(0, sys(OS::Syscall::Exit)),
+	mov(1, 0),
+	syscall(),
+	});
+
+// arithmetic and branches, registers only
+static const std::vector<uint16_t> compute_program = build_image({
+	mov(1, 1),
+	mov(2, 3),
+	mov(3, 0),
+	mov(7, 1),
+	add(3, 3, 1),       // 4: loop
+	mul(4, 3, 2),
+	sub(5, 4, 1),
+	div(6, 5, 2),
+	cmp_neq(4, 6, 3),
+	add(1, 1, 7),
+	jump_cond(4, 4),
+	jump(4),
+	});
+
+// increments every word of an array of 3072 words, from vaddr 512
+static constexpr uint32_t memory_program_size = 3584;
+
+static const std::vector<uint16_t> memory_program = build_image({
+	mov(1, 256),
+	add(1, 1, 1),       // r1 = 512, start
+	mov(2, 7),
+	mul(2, 2, 1),       // r2 = 3584, end
+	mov(7, 1),
+	mov(6, 0),
+	add(3, 1, 6),       // 6: r3 = start
+	load(4, 3),         // 7: loop
+	add(4, 4, 7),
+	store(3, 4),
+	add(3, 3, 7),
+	cmp_neq(5, 3, 2),
+	jump_cond(5, 7),
+	jump(6),
+	}, "", memory_program_size);
+
+// prints a line of 32 chars, over and over
+static const std::vector<uint16_t> print_program = build_image({
+	mov(0, sys(OS::Syscall::PrintStr)),
+	mov(1, data_vaddr),
+	mov(2, 32),
+	syscall(),
+	jump(0),
+	}, "0123456789abcdefghijklmnopqrstu\n");
+
+// reads the file in chunks of 256 words, over and over
+static constexpr std::string_view stream_fname = "stream.dat";
+static constexpr uint32_t stream_file_size = 49152; // words, larger than the physical memory
+
+static const std::vector<uint16_t> stream_program = build_image({
+	mov(7, 0),
+	mov(0, sys(OS::Syscall::OpenFile)),
+	mov(1, data_vaddr),
+	mov(2, stream_fname.size()),
+	syscall(),
+	add(6, 0, 7),       // r6 = file id
+	mov(0, sys(OS::Syscall::ReadFile)), // 6: loop
+	add(1, 6, 7),
+	mov(2, 128),
+	mov(3, 256),
+	syscall(),
+	cmp_neq(5, 0, 7),
+	jump_cond(5, 6),
+	mov(0, sys(OS::Syscall::SeekFile)),
+	add(1, 6, 7),
+	mov(2, 0),
+	syscall(),
+	jump(6),
+	}, stream_fname, 128 + 256);
+
+static std::vector<Bench> build_benches ()
+{
+	return {
+		{ .name = "compute", .files = { { "init.bin", compute_program } } },
+
+		// the same loop without and with paging
+		{ .name = "memory", .files = { { "init.bin", exit_program }, { "memory.bin", memory_program } }, .script = "\trun memory.bin baselimit\n" },
+		{ .name = "paging", .files = { { "init.bin", memory_program } } },
+
+		{ .name = "print", .files = { { "init.bin", print_program } } },
+		{ .name = "stream", .files = { { "init.bin", stream_program }, { std::string(stream_fname), std::vector<uint16_t>(stream_file_size, 0x1234) } } },
+	};
+}
+
+// ---------------------------------------
+
+static void write_file (const std::filesystem::path& path, const std::span<const uint16_t> words)
+{
+	std::ofstream file(path, std::ios::binary);
+	mylib_assert_exception_msg(file.is_open(), "cannot create ", path.string())
+
+	file.write(reinterpret_cast<const char*>(words.data()), words.size_bytes());
+	mylib_assert_exception_msg(file.good(), "cannot write ", path.string())
+}
+
+static void run_bench (const Bench& bench, const std::filesystem::path& dir, const uint64_t max_cycles)
+{
+	for (const File& file : bench.files)
+		write_file(dir / file.fname, file.words);
+
+	if (!bench.script.empty()) {
+		std::ofstream file(dir / "script.txt", std::ios::binary);
+		file << bench.script;
+	}
+
+	std::filesystem::current_path(dir);
+
+	auto computer = std::make_unique<Arch::Computer>(true);
+
+	if (!bench.script.empty())
+		computer->get_terminal().set_input_script("script.txt");
+
+	computer->get_cpu().set_trace(false);
+	OS::boot(&computer->get_cpu());
+
+	const auto start = Clock::now();
+	computer->run(max_cycles);
+	const double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+	const Cpu& cpu = computer->get_cpu();
+	const uint64_t cycles = computer->get_cycle();
+	const uint64_t instructions = cpu.get_instructions_retired();
+	uint64_t interrupts = 0;
+
+	for (uint16_t i = Cpu::CounterIndex::Interrupts; i < Cpu::CounterIndex::Count; i++)
+		interrupts += cpu.get_counter(i);
+
+	std::cout << "{\"bench\": \"" << bench.name << "\""
+		<< ", \"cycles\": " << cycles
+		<< ", \"instructions\": " << instructions
+		<< ", \"interrupts\": " << interrupts
+		<< ", \"seconds\": " << seconds
+		<< ", \"mips\": " << ((seconds > 0) ? (instructions / seconds / 1e6) : 0)
+		<< ", \"ns_per_instruction\": " << (instructions ? (seconds * 1e9 / instructions) : 0)
+		<< ", \"cycles_per_interrupt\": " << (interrupts ? (static_cast<double>(cycles) / interrupts) : 0)
+		<< "}" << std::endl;
+
+	computer.reset();
+	OS::shutdown();
+}
+
+// ---------------------------------------
+
+int main (int argc, char **argv)
+{
+	const std::filesystem::path old_dir = std::filesystem::current_path();
+	const std::filesystem::path dir = std::filesystem::temp_directory_path() / ("arq-sim-bench-" + std::to_string(getpid()));
+
+	try {
+		uint64_t max_cycles = bench_default_cycles;
+		std::vector<std::string_view> selected;
+
+		for (int i = 1; i < argc; i++) {
+			const std::string_view arg = argv[i];
+
+			if (arg == "-c" && (i + 1) < argc)
+				max_cycles = std::stoull(argv[++i]);
+			else
+				selected.push_back(arg);
+		}
+
+		std::filesystem::create_directories(dir);
+
+		for (const Bench& bench : build_benches()) {
+			if (!selected.empty() && std::ranges::find(selected, bench.name) == selected.end())
+				continue;
+
+			run_bench(bench, dir, max_cycles);
+		}
+
+		std::filesystem::current_path(old_dir);
+		std::filesystem::remove_all(dir);
+	}
+	catch (const std::exception& e) {
+		std::filesystem::current_path(old_dir);
+		std::filesystem::remove_all(dir);
+		std::cout << "Exception happenned!" << std::endl << e.what() << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
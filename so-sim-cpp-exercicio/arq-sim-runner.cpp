@@ -0,0 +1,349 @@
+#include <iostream>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <exception>
+#include <limits>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include <cstdint>
+#include <cstdlib>
+
+#include <my-lib/std.h>
+
+#include "config.h"
+#include "arch/computer.h"
+#include "arch/terminal.h"
+#include "arch/cpu.h"
+#include "os/os.h"
+
+/*
+	Runs a batch of guest jobs, each one in its own headless machine,
+	using all the host cores, and prints one line of results per job.
+
+	arq-sim-runner [-j threads] [-n copies] [-c max cycles] [-t] [-v] [jobs-file]
+
+	Each line of the jobs file has the arguments of arq-sim-so for one job,
+	[-r snapshot] [-l record log | -p replay log] [-s profile report [-m map]]
+	[-i counters report] [-e event trace] [-w watchpoint ...] [-a heatmap report]
+	[-k checkpoint file [-K cycles]] [input script], and runs copies times.
+	With more than one copy, the files written by a job get the copy number
+	before their extension (trace.json becomes trace.0.json, trace.1.json...).
+	Empty lines and lines starting with # are skipped. Without a jobs file,
+	the batch is copies plain boots. Jobs that boot load init.bin from the
+	current directory and all of them share the files of the disk, so jobs
+	that write to the same files should not run in the same batch.
+*/
+
+// ---------------------------------------
+
+using Clock = std::chrono::steady_clock;
+
+struct Job {
+	uint32_t line; // in the jobs file
+	std::string snapshot_fname; // empty to boot
+	std::string record_fname;
+	std::string replay_fname;
+	std::string profile_fname;
+	std::string map_fname;
+	std::string counters_fname;
+	std::string trace_fname;
+	std::vector<std::string> watchpoints;
+	std::string heatmap_fname;
+	std::string checkpoint_fname;
+	uint64_t checkpoint_interval = Config::checkpoint_interval_cycles;
+	std::string script_fname;
+};
+
+enum class JobStatus {
+	Finished,   // the machine had nothing left to do
+	CycleLimit,
+	Failed,     // raised an exception
+};
+
+struct JobResult {
+	JobStatus status = JobStatus::Failed;
+	uint64_t cycles = 0;
+	uint64_t instructions = 0;
+	uint64_t busy_cycles = 0;
+	double seconds = 0;
+	std::string error;
+	std::string kernel_output;
+	std::string app_output;
+};
+
+struct Options {
+	uint32_t nthreads = std::max(std::thread::hardware_concurrency(), 1u);
+	uint32_t copies = 1;
+	uint64_t max_cycles = std::numeric_limits<uint64_t>::max();
+	bool trace = false;
+	bool verbose = false;
+	const char *jobs_fname = nullptr;
+};
+
+// ---------------------------------------
+
+static const char* enum_class_to_str (const JobStatus value)
+{
+	switch (value) {
+		case JobStatus::Finished: return "finished";
+		case JobStatus::CycleLimit: return "cycle-limit";
+		case JobStatus::Failed: return "failed";
+	}
+
+	return "unknown";
+}
+
+// name.ext -> name.copy.ext
+static void add_copy_to_fname (std::string& fname, const uint32_t copy)
+{
+	if (fname.empty())
+		return;
+
+	std::filesystem::path path(fname);
+	path.replace_filename(Mylib::build_str_from_stream(path.stem().string(), '.', copy, path.extension().string()));
+	fname = path.string();
+}
+
+// each copy writes its own files
+static Job job_copy (Job job, const uint32_t copy)
+{
+	add_copy_to_fname(job.record_fname, copy);
+	add_copy_to_fname(job.profile_fname, copy);
+	add_copy_to_fname(job.counters_fname, copy);
+	add_copy_to_fname(job.trace_fname, copy);
+	add_copy_to_fname(job.heatmap_fname, copy);
+	add_copy_to_fname(job.checkpoint_fname, copy);
+
+	return job;
+}
+
+static std::vector<Job> load_jobs (const Options& options)
+{
+	if (options.jobs_fname == nullptr)
+		return std::vector<Job>(options.copies, Job { .line = 0 });
+
+	std::ifstream file(options.jobs_fname);
+
+	if (!file.is_open())
+		throw Mylib::Exception(Mylib::build_str_from_stream("cannot open jobs file ", options.jobs_fname));
+
+	std::vector<Job> jobs;
+	std::string line;
+
+	for (uint32_t nline = 1; std::getline(file, line); nline++) {
+		std::istringstream words(line);
+		std::vector<std::string> args;
+
+		for (std::string word; words >> word; )
+			args.push_back(word);
+
+		if (args.empty() || args[0].starts_with('#'))
+			continue;
+
+		Job job { .line = nline };
+
+		for (uint32_t i = 0; i < args.size(); i++) {
+			if (args[i] == "-r" && (i + 1) < args.size())
+				job.snapshot_fname = args[++i];
+			else if (args[i] == "-l" && (i + 1) < args.size())
+				job.record_fname = args[++i];
+			else if (args[i] == "-p" && (i + 1) < args.size())
+				job.replay_fname = args[++i];
+			else if (args[i] == "-s" && (i + 1) < args.size())
+				job.profile_fname = args[++i];
+			else if (args[i] == "-m" && (i + 1) < args.size())
+				job.map_fname = args[++i];
+			else if (args[i] == "-i" && (i + 1) < args.size())
+				job.counters_fname = args[++i];
+			else if (args[i] == "-e" && (i + 1) < args.size())
+				job.trace_fname = args[++i];
+			else if (args[i] == "-w" && (i + 1) < args.size())
+				job.watchpoints.push_back(args[++i]);
+			else if (args[i] == "-a" && (i + 1) < args.size())
+				job.heatmap_fname = args[++i];
+			else if (args[i] == "-k" && (i + 1) < args.size())
+				job.checkpoint_fname = args[++i];
+			else if (args[i] == "-K" && (i + 1) < args.size())
+				job.checkpoint_interval = std::stoull(args[++i]);
+			else
+				job.script_fname = args[i];
+		}
+
+		if (options.copies == 1)
+			jobs.push_back(job);
+		else {
+			for (uint32_t i = 0; i < options.copies; i++)
+				jobs.push_back(job_copy(job, i));
+		}
+	}
+
+	return jobs;
+}
+
+static JobResult run_job (const Job& job, const Options& options)
+{
+	JobResult result;
+	const auto start = Clock::now();
+
+	try {
+		auto computer = std::make_unique<Arch::Computer>(true);
+
+		if (!job.profile_fname.empty())
+			computer->get_cpu().start_profiler(Config::profiler_sample_cycles, job.profile_fname, job.map_fname);
+
+		if (!job.counters_fname.empty())
+			computer->get_cpu().set_counters_report(job.counters_fname);
+
+		for (const std::string& watchpoint : job.watchpoints)
+			computer->get_memory().add_watchpoint(watchpoint);
+
+		if (!job.heatmap_fname.empty())
+			computer->get_memory().set_heatmap_report(job.heatmap_fname);
+
+		if (!job.script_fname.empty())
+			computer->get_terminal().set_input_script(job.script_fname);
+
+		if (!job.snapshot_fname.empty())
+			computer->load_snapshot(job.snapshot_fname);
+		else
+			OS::boot(&computer->get_cpu());
+
+		if (!job.record_fname.empty())
+			computer->record_input(job.record_fname);
+		else if (!job.replay_fname.empty())
+			computer->replay_input(job.replay_fname);
+
+		if (!job.trace_fname.empty())
+			computer->start_event_trace(job.trace_fname);
+
+		if (!job.checkpoint_fname.empty())
+			computer->start_checkpoints(job.checkpoint_fname, job.checkpoint_interval);
+
+		// a snapshot has its own setting
+		computer->get_cpu().set_trace(options.trace);
+
+		computer->run(options.max_cycles);
+
+		result.status = computer->is_alive() ? JobStatus::CycleLimit : JobStatus::Finished;
+		result.cycles = computer->get_cycle();
+		result.instructions = computer->get_cpu().get_instructions_retired();
+		result.busy_cycles = computer->get_cpu().get_busy_cycles();
+		result.kernel_output = computer->get_terminal().get_text(Arch::Terminal::Type::Kernel);
+		result.app_output = computer->get_terminal().get_text(Arch::Terminal::Type::App);
+	}
+	catch (const std::exception& e) {
+		result.status = JobStatus::Failed;
+		result.error = e.what();
+	}
+
+	// the next job of the thread boots a new kernel
+	OS::shutdown();
+
+	result.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+	return result;
+}
+
+static void print_output (const std::string_view name, const std::string& text)
+{
+	std::istringstream lines(text);
+
+	for (std::string line; std::getline(lines, line); )
+		std::cout << '\t' << name << "| " << line << '\n';
+}
+
+// ---------------------------------------
+
+int main (int argc, char **argv)
+{
+	Options options;
+
+	try {
+		for (int i = 1; i < argc; i++) {
+			const std::string_view arg = argv[i];
+			const bool has_value = (i + 1) < argc;
+
+			if (arg == "-j" && has_value)
+				options.nthreads = std::max(std::stoul(argv[++i]), 1ul);
+			else if (arg == "-n" && has_value)
+				options.copies = std::stoul(argv[++i]);
+			else if (arg == "-c" && has_value)
+				options.max_cycles = std::stoull(argv[++i]);
+			else if (arg == "-t")
+				options.trace = true;
+			else if (arg == "-v")
+				options.verbose = true;
+			else if (!arg.starts_with('-'))
+				options.jobs_fname = argv[i];
+			else {
+				std::cout << "usage: " << argv[0] << " [-j threads] [-n copies] [-c max cycles] [-t] [-v] [jobs-file]" << std::endl;
+				return EXIT_FAILURE;
+			}
+		}
+
+		const std::vector<Job> jobs = load_jobs(options);
+		std::vector<JobResult> results(jobs.size());
+		std::atomic<uint32_t> next_job = 0;
+
+		const auto start = Clock::now();
+
+		{
+			std::vector<std::jthread> workers;
+
+			for (uint32_t i = 0; i < std::min<uint32_t>(options.nthreads, jobs.size()); i++) {
+				workers.emplace_back([&] {
+					for (uint32_t j = next_job++; j < jobs.size(); j = next_job++)
+						results[j] = run_job(jobs[j], options);
+				});
+			}
+		}
+
+		const double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+		uint64_t total_instructions = 0;
+		uint64_t total_cycles = 0;
+		uint32_t failed = 0;
+
+		std::cout << "job\tline\tstatus\tcycles\tinstructions\tbusy_cycles\tseconds" << std::endl;
+
+		for (uint32_t i = 0; i < jobs.size(); i++) {
+			const JobResult& result = results[i];
+
+			std::cout << i << '\t' << jobs[i].line << '\t' << enum_class_to_str(result.status)
+				<< '\t' << result.cycles << '\t' << result.instructions
+				<< '\t' << result.busy_cycles << '\t' << result.seconds << '\n';
+
+			if (result.status == JobStatus::Failed) {
+				std::cout << "\terror| " << result.error << '\n';
+				failed++;
+			}
+
+			if (options.verbose) {
+				print_output("kernel", result.kernel_output);
+				print_output("app", result.app_output);
+			}
+
+			total_instructions += result.instructions;
+			total_cycles += result.cycles;
+		}
+
+		std::cout << "total: " << jobs.size() << " jobs, " << failed << " failed, "
+			<< options.nthreads << " threads, " << total_cycles << " cycles, "
+			<< total_instructions << " instructions, " << seconds << " seconds, "
+			<< (seconds > 0 ? total_instructions / seconds / 1e6 : 0) << " MIPS" << std::endl;
+
+		return (failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+	}
+	catch (const std::exception& e) {
+		std::cout << "Exception happenned!" << std::endl << e.what() << std::endl;
+		return EXIT_FAILURE;
+	}
+}
@@ -1,5 +1,6 @@
 #include <iostream>
 #include <exception>
+#include <string_view>
 
 #include <cstdint>
 #include <cstdlib>
@@ -12,6 +13,7 @@
 #include "lib.h"
 #include "arch/computer.h"
 #include "arch/terminal.h"
+#include "arch/memory.h"
 #include "os/os.h"
 
 // ---------------------------------------
@@ -39,7 +41,78 @@ int main (int argc, char **argv)
 
 	try {
 		Arch::Computer::init();
-		OS::boot(&Arch::Computer::get().get_cpu());
+
+		// arq-sim-so [-r snapshot] [-l record log | -p replay log] [-s profile report [-m map]] [-i counters report] [-e event trace] [-w watchpoint ...] [-a heatmap report] [-k checkpoint file [-K cycles]] [input script]
+		const char *snapshot_fname = nullptr;
+		const char *record_fname = nullptr;
+		const char *replay_fname = nullptr;
+		const char *profile_fname = nullptr;
+		const char *map_fname = "";
+		const char *counters_fname = nullptr;
+		const char *trace_fname = nullptr;
+		const char *heatmap_fname = nullptr;
+		const char *checkpoint_fname = nullptr;
+		uint64_t checkpoint_interval = Config::checkpoint_interval_cycles;
+		const char *script_fname = nullptr;
+
+		for (int i = 1; i < argc; i++) {
+			const std::string_view arg = argv[i];
+
+			if (arg == "-r" && (i + 1) < argc)
+				snapshot_fname = argv[++i];
+			else if (arg == "-l" && (i + 1) < argc)
+				record_fname = argv[++i];
+			else if (arg == "-p" && (i + 1) < argc)
+				replay_fname = argv[++i];
+			else if (arg == "-s" && (i + 1) < argc)
+				profile_fname = argv[++i];
+			else if (arg == "-m" && (i + 1) < argc)
+				map_fname = argv[++i];
+			else if (arg == "-i" && (i + 1) < argc)
+				counters_fname = argv[++i];
+			else if (arg == "-e" && (i + 1) < argc)
+				trace_fname = argv[++i];
+			else if (arg == "-w" && (i + 1) < argc)
+				Arch::Computer::get().get_memory().add_watchpoint(argv[++i]);
+			else if (arg == "-a" && (i + 1) < argc)
+				heatmap_fname = argv[++i];
+			else if (arg == "-k" && (i + 1) < argc)
+				checkpoint_fname = argv[++i];
+			else if (arg == "-K" && (i + 1) < argc)
+				checkpoint_interval = std::stoull(argv[++i]);
+			else
+				script_fname = argv[i];
+		}
+
+		if (profile_fname != nullptr)
+			Arch::Computer::get().get_cpu().start_profiler(Config::profiler_sample_cycles, profile_fname, map_fname);
+
+		if (counters_fname != nullptr)
+			Arch::Computer::get().get_cpu().set_counters_report(counters_fname);
+
+		if (heatmap_fname != nullptr)
+			Arch::Computer::get().get_memory().set_heatmap_report(heatmap_fname);
+
+		// optional file with the keys to feed to the guest
+		if (script_fname != nullptr)
+			Arch::Computer::get().get_terminal().set_input_script(script_fname);
+
+		if (snapshot_fname != nullptr)
+			Arch::Computer::get().load_snapshot(snapshot_fname);
+		else
+			OS::boot(&Arch::Computer::get().get_cpu());
+
+		if (record_fname != nullptr)
+			Arch::Computer::get().record_input(record_fname);
+		else if (replay_fname != nullptr)
+			Arch::Computer::get().replay_input(replay_fname);
+
+		if (trace_fname != nullptr)
+			Arch::Computer::get().start_event_trace(trace_fname);
+
+		if (checkpoint_fname != nullptr)
+			Arch::Computer::get().start_checkpoints(checkpoint_fname, checkpoint_interval);
+
 		Arch::Computer::get().run();
 
 		endwin();
@@ -11,8 +11,29 @@ namespace Config {
 
 	inline constexpr uint16_t timer_default_interrupt_cycles = 1024;
 
+	// channel 0 is the periodic timer of TimerInterruptCycles
+	inline constexpr uint16_t timer_channels = 4;
+
+	// default cycles between samples of the profiler
+	inline constexpr uint32_t profiler_sample_cycles = 1000;
+
+	// default cycles between checkpoints, a few seconds of the host
+	inline constexpr uint64_t checkpoint_interval_cycles = 10'000'000;
+
 	inline constexpr uint32_t disk_interrupt_cycles = 1024 * 10;
 
+	inline constexpr uint32_t terminal_input_buffer_size = 256;
+
+	inline constexpr uint32_t terminal_command_buffer_size = 64;
+
+	// switches the keyboard between the apps and the command terminal
+	inline constexpr uint16_t terminal_focus_key = '\t';
+
+	// size of each screen of a headless terminal, where nothing is shown
+	inline constexpr uint32_t terminal_headless_rows = 100;
+
+	inline constexpr uint32_t terminal_headless_cols = 80;
+
 	// ---------------------------------------
 
 	// Don't change this
@@ -0,0 +1,381 @@
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <iomanip>
+#include <limits>
+#include <numeric>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "../config.h"
+#include "../arch/arch.h"
+#include "os.h"
+#include "os-lib.h"
+#include "frames.h"
+#include "process.h"
+#include "syscall.h"
+#include "loader.h"
+#include "page-cache.h"
+#include "command.h"
+
+namespace OS {
+
+// ---------------------------------------
+
+using CommandHandler = void (*) (const std::string_view args);
+
+struct Command {
+	const char *name;
+	const char *help;
+	CommandHandler handler;
+};
+
+static thread_local std::string line;
+
+// ---------------------------------------
+
+template <typename... Types>
+static void print (Types&&... vars)
+{
+	terminal_print(cpu, Terminal::Command, vars...);
+}
+
+template <typename... Types>
+static void println (Types&&... vars)
+{
+	terminal_println(cpu, Terminal::Command, vars...);
+}
+
+static void print_prompt ()
+{
+	print("> ");
+}
+
+// fits the narrow columns of the command terminal
+static std::string compact_number (const uint64_t value)
+{
+	if (value < 10'000)
+		return std::to_string(value);
+	else if (value < 10'000'000)
+		return std::to_string(value / 1'000) + "k";
+	else
+		return std::to_string(value / 1'000'000) + "M";
+}
+
+static std::vector<std::string_view> split (const std::string_view str)
+{
+	std::vector<std::string_view> tokens;
+	std::size_t pos = 0;
+
+	while ((pos = str.find_first_not_of(' ', pos)) != std::string_view::npos) {
+		const auto end = std::min(str.find(' ', pos), str.size());
+		tokens.push_back(str.substr(pos, end - pos));
+		pos = end;
+	}
+
+	return tokens;
+}
+
+static std::optional<uint32_t> parse_number (const std::string_view str)
+{
+	uint32_t value;
+	const auto [ptr, ec] = std::from_chars(str.data(), str.data() + str.size(), value);
+
+	if (ec != std::errc() || ptr != str.data() + str.size())
+		return std::nullopt;
+
+	return value;
+}
+
+static std::optional<bool> parse_on_off (const std::string_view str)
+{
+	if (str == "on")
+		return true;
+	else if (str == "off")
+		return false;
+	return std::nullopt;
+}
+
+static const char* on_off_str (const bool value)
+{
+	return value ? "on" : "off";
+}
+
+static char state_char (const Process *process)
+{
+	switch (process->state) {
+		using enum Process::State;
+
+		case Ready:   return 'R';
+		case Running: return 'X';
+		case Blocked: return process->sleeping ? 'S' : 'B';
+	}
+
+	return '?';
+}
+
+// ---------------------------------------
+
+static void cmd_help (const std::string_view args);
+
+static void cmd_ps (const std::string_view args)
+{
+	println(std::setw(3), "PID", std::setw(5), "PPID", " S NAME");
+
+	for (const Process *process : process_list()) {
+		println(std::setw(3), process->pid,
+			std::setw(5), (process->parent_pid == invalid_pid) ? std::string("-") : std::to_string(process->parent_pid),
+			' ', state_char(process),
+			' ', process->name);
+	}
+}
+
+static void cmd_top (const std::string_view args)
+{
+	process_account_current();
+
+	auto list = process_list();
+
+	std::ranges::sort(list, std::ranges::greater(), [] (const Process *process) {
+		return process->stats.cycles;
+	});
+
+	const uint64_t total = std::max<uint64_t>(1, std::accumulate(list.begin(), list.end(), uint64_t(0), [] (const uint64_t sum, const Process *process) {
+		return sum + process->stats.cycles;
+	}));
+
+	println(std::setw(3), "PID", std::setw(5), "CPU%", std::setw(6), "INSTR",
+		std::setw(5), "FLT", std::setw(5), "SYS", std::setw(5), "CSW", std::setw(6), "IO");
+
+	for (const Process *process : list) {
+		const auto& stats = process->stats;
+		const uint64_t faults = std::accumulate(stats.faults.begin(), stats.faults.end(), uint64_t(0));
+
+		println(std::setw(3), process->pid,
+			std::setw(5), (stats.cycles * 100) / total,
+			std::setw(6), compact_number(stats.instructions),
+			std::setw(5), compact_number(faults),
+			std::setw(5), compact_number(stats.syscalls),
+			std::setw(5), compact_number(stats.context_switches),
+			std::setw(6), compact_number(stats.disk_read_bytes + stats.disk_write_bytes));
+	}
+}
+
+static void cmd_run (const std::string_view args)
+{
+	const auto tokens = split(args);
+	VmemMode mode = default_vmem_mode;
+
+	if (tokens.empty() || tokens.size() > 2) {
+		println("usage: run <file> [paging|baselimit]");
+		return;
+	}
+
+	if (tokens.size() == 2) {
+		if (tokens[1] == "paging")
+			mode = VmemMode::Paging;
+		else if (tokens[1] == "baselimit")
+			mode = VmemMode::BaseLimit;
+		else {
+			println("invalid mode: ", tokens[1]);
+			return;
+		}
+	}
+
+	Process *process = load_program(tokens[0], mode, invalid_pid);
+
+	if (process == nullptr) {
+		println("cannot load ", tokens[0]);
+		return;
+	}
+
+	sched_add(process);
+
+	println("started pid ", process->pid);
+}
+
+static void cmd_kill (const std::string_view args)
+{
+	const auto tokens = split(args);
+	const auto pid = (tokens.size() == 1) ? parse_number(tokens[0]) : std::nullopt;
+
+	if (!pid) {
+		println("usage: kill <pid>");
+		return;
+	}
+
+	Process *process = (*pid < invalid_pid) ? process_get(*pid) : nullptr;
+
+	if (process == nullptr) {
+		println("no process ", *pid);
+		return;
+	}
+
+	process_kill(process, "killed from the command terminal");
+}
+
+static void cmd_mem (const std::string_view args)
+{
+	println("free frames: ", frames_free_count(), "/", nframes);
+	println("page cache: ", page_cache_size(), " frames");
+}
+
+static void cmd_mix (const std::string_view args)
+{
+	using Cpu = Arch::Cpu;
+	using Index = Cpu::CounterIndex;
+
+	const auto r = [] (const Cpu::OpcodeR opcode) {
+		return cpu_read_counter(cpu, Index::OpcodesR + std::to_underlying(opcode));
+	};
+
+	const auto i = [] (const Cpu::OpcodeI opcode) {
+		return cpu_read_counter(cpu, Index::OpcodesI + std::to_underlying(opcode));
+	};
+
+	const uint64_t alu = r(Cpu::OpcodeR::Add) + r(Cpu::OpcodeR::Sub) + r(Cpu::OpcodeR::Mul)
+		+ r(Cpu::OpcodeR::Div) + r(Cpu::OpcodeR::Cmp_equal) + r(Cpu::OpcodeR::Cmp_neq);
+	const uint64_t taken = cpu_read_counter(cpu, Index::JumpCondTaken);
+	uint64_t exceptions = 0;
+
+	for (uint16_t e = Index::Exceptions; e < Index::Interrupts; e++)
+		exceptions += cpu_read_counter(cpu, e);
+
+	println("alu ", compact_number(alu), " mov ", compact_number(i(Cpu::OpcodeI::Mov)));
+	println("load ", compact_number(r(Cpu::OpcodeR::Load)), " store ", compact_number(r(Cpu::OpcodeR::Store)));
+	println("jump ", compact_number(i(Cpu::OpcodeI::Jump)), " jump_cond ", compact_number(taken),
+		" taken ", compact_number(i(Cpu::OpcodeI::Jump_cond) - taken), " not");
+	println("syscall ", compact_number(r(Cpu::OpcodeR::Syscall)), " exceptions ", compact_number(exceptions));
+}
+
+static void cmd_set (const std::string_view args)
+{
+	const auto tokens = split(args);
+
+	if (tokens.empty()) {
+		println("quantum ", cpu->read_io(IO_Port::TimerInterruptCycles));
+		println("preempt ", on_off_str(sched_is_preemptive()));
+		println("trace ", on_off_str(cpu->get_trace()));
+		println("strace ", on_off_str(syscall_is_traced()));
+		return;
+	}
+
+	if (tokens.size() != 2) {
+		println("usage: set [<option> <value>]");
+		return;
+	}
+
+	const std::string_view option = tokens[0];
+
+	if (option == "quantum") {
+		const auto cycles = parse_number(tokens[1]);
+
+		if (!cycles || *cycles == 0 || *cycles > std::numeric_limits<uint16_t>::max())
+			println("invalid amount of cycles: ", tokens[1]);
+		else
+			cpu->write_io(IO_Port::TimerInterruptCycles, *cycles);
+
+		return;
+	}
+
+	const auto value = parse_on_off(tokens[1]);
+
+	if (!value)
+		println("expected on or off: ", tokens[1]);
+	else if (option == "preempt")
+		sched_set_preemptive(*value);
+	else if (option == "trace")
+		cpu->set_trace(*value);
+	else if (option == "strace")
+		syscall_set_trace(*value);
+	else
+		println("unknown option: ", option);
+}
+
+static void cmd_snapshot (const std::string_view args)
+{
+	const auto tokens = split(args);
+
+	if (tokens.size() != 1) {
+		println("usage: snapshot <file>");
+		return;
+	}
+
+	// the machine saves it once this interrupt is handled
+	cpu->get_computer().request_snapshot(tokens[0]);
+}
+
+static constexpr auto commands = std::to_array<Command>({
+	{ "help", "list the commands", cmd_help },
+	{ "ps", "processes, S: R ready, X running, B blocked, S sleeping", cmd_ps },
+	{ "top", "processes by cpu usage, with faults, syscalls, context switches and disk bytes", cmd_top },
+	{ "run", "<file> [paging|baselimit], starts a program", cmd_run },
+	{ "kill", "<pid>", cmd_kill },
+	{ "mem", "free frames and page cache size", cmd_mem },
+	{ "mix", "instructions executed since power on, by kind", cmd_mix },
+	{ "snapshot", "<file>, saves the whole machine, restored with arq-sim-so -r <file>", cmd_snapshot },
+	{ "set", "[<option> <value>], shows or changes: quantum <cycles>, preempt on|off, trace on|off (cpu instructions), strace on|off (syscalls)", cmd_set },
+	});
+
+static void cmd_help (const std::string_view args)
+{
+	for (const Command& command : commands)
+		println(command.name, ": ", command.help);
+}
+
+static void execute (const std::string_view str)
+{
+	const auto tokens = split(str);
+
+	if (tokens.empty())
+		return;
+
+	const std::string_view name = tokens[0];
+	const std::string_view args = str.substr(name.data() + name.size() - str.data());
+
+	const auto it = std::ranges::find(commands, name, &Command::name);
+
+	if (it == commands.end())
+		println("unknown command: ", name);
+	else
+		it->handler(args);
+}
+
+// ---------------------------------------
+
+void command_init ()
+{
+	line.clear();
+	println("Tab switches the keyboard");
+	print_prompt();
+}
+
+void command_keyboard_interrupt ()
+{
+	while (const uint16_t c = cpu->read_io(IO_Port::TerminalReadCommandChar)) {
+		if (terminal_is_return(c)) {
+			print('\n');
+			execute(line);
+			line.clear();
+			print_prompt();
+		}
+		else if (terminal_is_backspace(c)) {
+			if (!line.empty()) {
+				line.pop_back();
+				print('\r'); // clears the row
+				print_prompt();
+				print(line);
+			}
+		}
+		else {
+			line += static_cast<char>(c);
+			print(static_cast<char>(c));
+		}
+	}
+}
+
+// ---------------------------------------
+
+} // end namespace
@@ -0,0 +1,32 @@
+#ifndef __ARQSIM_HEADER_OS_COMMAND_H__
+#define __ARQSIM_HEADER_OS_COMMAND_H__
+
+#include <cstdint>
+
+#include <my-lib/std.h>
+#include <my-lib/macros.h>
+
+#include "../config.h"
+#include "../arch/arch.h"
+#include "os.h"
+
+namespace OS {
+
+// ---------------------------------------
+
+/*
+	Kernel command line, in the Command terminal.
+	Config::terminal_focus_key switches the keyboard between
+	the apps and the command terminal.
+*/
+
+void command_init ();
+
+// reads the keys typed in the command terminal, called by the Keyboard interrupt
+void command_keyboard_interrupt ();
+
+// ---------------------------------------
+
+} // end namespace
+
+#endif
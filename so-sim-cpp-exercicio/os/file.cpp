@@ -0,0 +1,985 @@
+#include <algorithm>
+#include <array>
+#include <limits>
+#include <optional>
+#include <span>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "../config.h"
+#include "../arch/arch.h"
+#include "os.h"
+#include "frames.h"
+#include "process.h"
+#include "syscall.h"
+#include "wait.h"
+#include "page-cache.h"
+#include "file.h"
+
+namespace OS {
+
+// ---------------------------------------
+
+using PteField = Arch::Cpu::PteField;
+
+// One per file name, shared by all handles that opened the file.
+// Survives the last close, so its pages stay in the page cache.
+struct FileNode {
+	uint16_t id;
+	std::optional<uint16_t> disk_id; // while the file is open in the disk
+	uint32_t nhandles = 0;
+
+	uint32_t size = 0;
+	uint32_t disk_pos = 0; // position of the file in the disk
+
+	// write-behind, contents to be written at write_buffer_pos
+	std::vector<uint16_t> write_buffer;
+	uint32_t write_buffer_pos = 0;
+
+	// reported by the next syscall on the file
+	bool write_error = false;
+	bool read_error = false;
+};
+
+// One per open, this is the file id seen by the guest.
+// Only the process that opened the file can use it.
+struct FileHandle {
+	FileNode *node;
+	uint16_t pid;
+	uint32_t pos = 0;
+	uint32_t readahead = file_readahead_min;
+	uint32_t last_read_end = 0;
+};
+
+// file pages mapped in the address space of a process
+struct Mapping {
+	FileNode *node;
+	uint16_t vpage;     // first virtual page
+	uint16_t npages;
+	uint16_t file_page; // file page mapped at vpage
+};
+
+struct DiskRequest {
+	enum class Type {
+		Read,
+		Write,
+		Writeback // a dirty page of the page cache
+	};
+
+	Type type;
+	FileNode *node;
+	uint32_t pos;
+	uint16_t size;
+	uint16_t pid; // accounted for the transfer, invalid_pid for write-backs
+	uint32_t generation = 0; // of the dirty page, for write-backs
+};
+
+static thread_local std::unordered_map<std::string, FileNode> nodes;
+static thread_local std::unordered_map<uint16_t, FileNode*> nodes_by_id;
+static thread_local uint16_t next_node_id = 0;
+
+static thread_local std::unordered_map<uint16_t, FileHandle> handles;
+static thread_local uint16_t next_handle_id = 1;
+
+static thread_local std::unordered_map<uint16_t, std::vector<Mapping>> mappings; // by pid
+
+static thread_local std::optional<DiskRequest> disk_request;
+
+// processes waiting for the disk to become idle, or for their request to complete
+static thread_local WaitQueue disk_wait;
+
+// ---------------------------------------
+
+static bool disk_is_busy ()
+{
+	return disk_request || cpu->read_io(IO_Port::DiskState) != std::to_underlying(DiskState::Idle);
+}
+
+static bool disk_no_error ()
+{
+	return cpu->read_io(IO_Port::DiskError) == std::to_underlying(DiskError::NoError);
+}
+
+static bool disk_select_file (const FileNode& node)
+{
+	cpu->write_io(IO_Port::DiskFileID, *node.disk_id);
+	return disk_no_error();
+}
+
+// the disk file must be selected
+static bool disk_seek (FileNode& node, const uint32_t pos)
+{
+	if (node.disk_pos == pos)
+		return true;
+
+	if (pos > std::numeric_limits<uint16_t>::max())
+		return false;
+
+	cpu->write_io(IO_Port::DiskData, pos);
+	cpu->write_io(IO_Port::DiskCmd, std::to_underlying(DiskCmd::SeekFilePos));
+
+	if (!disk_no_error())
+		return false;
+
+	node.disk_pos = pos;
+
+	return true;
+}
+
+static FileHandle* get_handle (const Process *process, const uint16_t file_id)
+{
+	const auto it = handles.find(file_id);
+	return (it == handles.end() || it->second.pid != process->pid) ? nullptr : &it->second;
+}
+
+// Sends the write-behind buffer to the disk, which must be idle.
+static bool start_flush (FileNode& node, const uint16_t pid)
+{
+	if (!disk_select_file(node) || !disk_seek(node, node.write_buffer_pos)) {
+		node.write_buffer.clear();
+		return false;
+	}
+
+	cpu->write_io(IO_Port::DiskData, node.write_buffer.size());
+	cpu->write_io(IO_Port::DiskCmd, std::to_underlying(DiskCmd::WriteFile));
+
+	for (const uint16_t v : node.write_buffer)
+		cpu->write_io(IO_Port::DiskData, v);
+
+	disk_request = DiskRequest {
+		.type = DiskRequest::Type::Write,
+		.node = &node,
+		.pos = node.write_buffer_pos,
+		.size = static_cast<uint16_t>(node.write_buffer.size()),
+		.pid = pid
+		};
+
+	return true;
+}
+
+// Flushes the write-behind buffer of a file closed by an exiting process,
+// if the disk is idle, since no syscall on the file will do it.
+static void orphan_flush_kick ()
+{
+	if (disk_is_busy())
+		return;
+
+	for (auto& [fname, node] : nodes) {
+		if (node.nhandles == 0 && !node.write_buffer.empty()) {
+			if (start_flush(node, invalid_pid))
+				return;
+		}
+	}
+}
+
+// The process restarts its syscall once the disk is done.
+static SyscallResult flush (Process *process, FileNode& node)
+{
+	if (disk_is_busy())
+		return syscall_wait_and_restart(process, disk_wait);
+
+	if (!start_flush(node, process->pid))
+		return syscall_error;
+
+	return syscall_wait_and_restart(process, disk_wait);
+}
+
+// Reads [start, start + size) into the page cache, the disk must be idle.
+// start must be page aligned.
+static bool start_read (FileNode& node, const uint32_t start, const uint16_t size, const uint16_t pid)
+{
+	if (!disk_select_file(node) || !disk_seek(node, start))
+		return false;
+
+	cpu->write_io(IO_Port::DiskData, size);
+	cpu->write_io(IO_Port::DiskCmd, std::to_underlying(DiskCmd::ReadFile));
+
+	disk_request = DiskRequest {
+		.type = DiskRequest::Type::Read,
+		.node = &node,
+		.pos = start,
+		.size = size,
+		.pid = pid
+		};
+
+	return true;
+}
+
+// Writes back a dirty page of the page cache, if the disk is idle.
+static void writeback_kick ()
+{
+	while (!disk_is_busy()) {
+		const auto dirty = page_cache_first_dirty();
+
+		if (!dirty)
+			return;
+
+		FileNode& node = *nodes_by_id.at(dirty->node);
+		const uint32_t pos = dirty->page * Config::page_size;
+
+		// writes beyond the end of the file are dropped
+		if (pos >= node.size || !disk_select_file(node) || !disk_seek(node, pos)) {
+			page_cache_mark_clean(dirty->node, dirty->page, dirty->generation);
+			continue;
+		}
+
+		const uint16_t size = std::min<uint32_t>(Config::page_size, node.size - pos);
+
+		cpu->write_io(IO_Port::DiskData, size);
+		cpu->write_io(IO_Port::DiskCmd, std::to_underlying(DiskCmd::WriteFile));
+
+		for (uint32_t i = 0; i < size; i++)
+			cpu->write_io(IO_Port::DiskData, cpu->pmem_read(frame_to_paddr(dirty->frame) + i));
+
+		disk_request = DiskRequest {
+			.type = DiskRequest::Type::Writeback,
+			.node = &node,
+			.pos = pos,
+			.size = size,
+			.pid = invalid_pid,
+			.generation = dirty->generation
+			};
+	}
+}
+
+// closes the disk file once nothing uses it and its data is on the disk
+static void node_close_if_unused (FileNode& node)
+{
+	if (node.nhandles > 0 || !node.disk_id || !node.write_buffer.empty()
+		|| page_cache_has_dirty(node.id) || disk_is_busy())
+		return;
+
+	if (disk_select_file(node))
+		cpu->write_io(IO_Port::DiskCmd, std::to_underlying(DiskCmd::CloseFile));
+
+	node.disk_id.reset();
+}
+
+// Copies [pos, pos + size) of the file through the page cache, stopping at
+// the first page that is not cached. Returns the amount copied, or
+// std::nullopt if the process buffer is not accessible.
+static std::optional<uint32_t> copy_from_cache (Process *process, const FileNode& node, const uint32_t pos, const uint16_t vaddr, const uint32_t size)
+{
+	std::array<uint16_t, Config::page_size> buffer;
+	uint32_t done = 0;
+
+	while (done < size) {
+		const auto frame = page_cache_lookup(node.id, (pos + done) >> Config::page_size_bits);
+
+		if (!frame)
+			break;
+
+		const uint32_t offset = (pos + done) & (Config::page_size - 1);
+		const uint32_t length = std::min<uint32_t>(Config::page_size - offset, size - done);
+		const uint16_t paddr = frame_to_paddr(*frame) + offset;
+
+		for (uint32_t i = 0; i < length; i++)
+			buffer[i] = cpu->pmem_read(paddr + i);
+
+		if (!process_write_mem(process, vaddr + done, std::span(buffer).first(length)))
+			return std::nullopt;
+
+		done += length;
+	}
+
+	return done;
+}
+
+// keeps the cached pages in sync with data that is still in the write-behind buffer
+static void write_through_cache (const FileNode& node, const uint32_t pos, const std::span<const uint16_t> data)
+{
+	for (uint32_t i = 0; i < data.size(); i++) {
+		const auto frame = page_cache_lookup(node.id, (pos + i) >> Config::page_size_bits);
+
+		if (frame)
+			cpu->pmem_write(frame_to_paddr(*frame) + ((pos + i) & (Config::page_size - 1)), data[i]);
+	}
+}
+
+// ---------------------------------------
+
+SyscallResult file_open (Process *process, const SyscallArgs& args)
+{
+	std::vector<uint16_t> buffer(args.r2);
+
+	if (!process_read_mem(process, args.r1, buffer))
+		return syscall_error;
+
+	const std::string fname(buffer.begin(), buffer.end());
+	auto it = nodes.find(fname);
+
+	if (it == nodes.end() || !it->second.disk_id) {
+		if (disk_is_busy())
+			return syscall_wait_and_restart(process, disk_wait);
+
+		cpu->write_io(IO_Port::DiskCmd, std::to_underlying(DiskCmd::SetFname));
+
+		for (const uint16_t c : buffer)
+			cpu->write_io(IO_Port::DiskData, c);
+
+		cpu->write_io(IO_Port::DiskData, 0);
+
+		cpu->write_io(IO_Port::DiskCmd, std::to_underlying(DiskCmd::OpenFile));
+
+		if (!disk_no_error())
+			return syscall_error;
+
+		const uint16_t disk_id = cpu->read_io(IO_Port::DiskFileID);
+
+		cpu->write_io(IO_Port::DiskCmd, std::to_underlying(DiskCmd::GetFileSize));
+		const uint16_t size = cpu->read_io(IO_Port::DiskData);
+
+		if (it == nodes.end()) {
+			it = nodes.insert(std::make_pair(fname, FileNode { .id = next_node_id++ })).first;
+			nodes_by_id.insert(std::make_pair(it->second.id, &it->second));
+		}
+		else if (it->second.size != size)
+			page_cache_drop(it->second.id); // changed since it was cached
+
+		FileNode& node = it->second;
+
+		node.disk_id = disk_id;
+		node.size = size;
+		node.disk_pos = 0;
+	}
+
+	while (handles.contains(next_handle_id) || next_handle_id == syscall_error || next_handle_id == 0)
+		next_handle_id++;
+
+	const uint16_t file_id = next_handle_id++;
+
+	handles.insert(std::make_pair(file_id, FileHandle { .node = &it->second, .pid = process->pid }));
+	it->second.nhandles++;
+
+	return file_id;
+}
+
+SyscallResult file_read (Process *process, const SyscallArgs& args)
+{
+	FileHandle *handle = get_handle(process, args.r1);
+
+	if (handle == nullptr)
+		return syscall_error;
+
+	FileNode& node = *handle->node;
+
+	if (node.read_error) {
+		node.read_error = false;
+		return syscall_error;
+	}
+
+	if (args.r3 == 0 || handle->pos >= node.size)
+		return 0;
+
+	const uint32_t size = std::min<uint32_t>(args.r3, node.size - handle->pos);
+	const auto amount = copy_from_cache(process, node, handle->pos, args.r2, size);
+
+	if (!amount)
+		return syscall_error;
+
+	if (*amount > 0) {
+		handle->pos += *amount;
+		handle->last_read_end = handle->pos;
+		return *amount;
+	}
+
+	// miss, the disk must be up to date before it is read
+	if (!node.write_buffer.empty())
+		return flush(process, node);
+
+	if (disk_is_busy())
+		return syscall_wait_and_restart(process, disk_wait);
+
+	if (handle->pos > 0 && handle->pos == handle->last_read_end)
+		handle->readahead = std::min(handle->readahead * 2, file_readahead_max);
+	else
+		handle->readahead = file_readahead_min;
+
+	// whole pages, from the one that missed
+	const uint32_t start = handle->pos & ~(Config::page_size - 1);
+	const uint32_t end = std::min(handle->pos + std::max(size, handle->readahead), node.size);
+	const uint16_t request_size = std::min(end - start, file_readahead_max);
+
+	if (!start_read(node, start, request_size, process->pid))
+		return syscall_error;
+
+	return syscall_wait_and_restart(process, disk_wait);
+}
+
+SyscallResult file_write (Process *process, const SyscallArgs& args)
+{
+	FileHandle *handle = get_handle(process, args.r1);
+
+	if (handle == nullptr)
+		return syscall_error;
+
+	FileNode& node = *handle->node;
+
+	if (node.write_error) {
+		node.write_error = false;
+		return syscall_error;
+	}
+
+	if (args.r3 == 0)
+		return 0;
+
+	const bool contiguous = node.write_buffer.empty()
+		|| handle->pos == node.write_buffer_pos + node.write_buffer.size();
+	const uint32_t room = file_write_buffer_size - node.write_buffer.size();
+
+	if (!contiguous || room == 0)
+		return flush(process, node);
+
+	if (node.write_buffer.empty())
+		node.write_buffer_pos = handle->pos;
+
+	const uint32_t used = node.write_buffer.size();
+	const uint32_t amount = std::min<uint32_t>(args.r3, room);
+
+	node.write_buffer.resize(used + amount);
+
+	const auto data = std::span(node.write_buffer).subspan(used);
+
+	if (!process_read_mem(process, args.r2, data)) {
+		node.write_buffer.resize(used);
+		return syscall_error;
+	}
+
+	write_through_cache(node, handle->pos, data);
+
+	handle->pos += amount;
+	node.size = std::max(node.size, handle->pos);
+
+	return amount;
+}
+
+SyscallResult file_seek (Process *process, const SyscallArgs& args)
+{
+	FileHandle *handle = get_handle(process, args.r1);
+
+	if (handle == nullptr)
+		return syscall_error;
+
+	handle->pos = args.r2;
+
+	return handle->pos;
+}
+
+SyscallResult file_close (Process *process, const SyscallArgs& args)
+{
+	FileHandle *handle = get_handle(process, args.r1);
+
+	if (handle == nullptr)
+		return syscall_error;
+
+	FileNode& node = *handle->node;
+
+	if (!node.write_buffer.empty())
+		return flush(process, node);
+
+	// the last one waits until the file is on the disk
+	if (node.nhandles == 1 && (disk_is_busy() || page_cache_has_dirty(node.id))) {
+		writeback_kick();
+		return syscall_wait_and_restart(process, disk_wait);
+	}
+
+	const bool error = node.write_error;
+	node.write_error = false;
+
+	node.nhandles--;
+	handles.erase(args.r1);
+
+	node_close_if_unused(node);
+
+	return error ? syscall_error : 0;
+}
+
+// ---------------------------------------
+
+static Mapping* find_mapping (Process *process, const uint16_t vpage)
+{
+	const auto it = mappings.find(process->pid);
+
+	if (it == mappings.end())
+		return nullptr;
+
+	for (Mapping& mapping : it->second) {
+		if (vpage >= mapping.vpage && vpage < mapping.vpage + mapping.npages)
+			return &mapping;
+	}
+
+	return nullptr;
+}
+
+// Calls fn(process, vpage, pte) for each page table entry that maps
+// the frame of a cached page through a file mapping.
+template <typename Function>
+static void for_each_mapped_pte (const uint16_t node, const uint16_t page, const uint16_t frame, Function fn)
+{
+	for (auto& [pid, list] : mappings) {
+		Process *process = process_get(pid);
+
+		if (process == nullptr)
+			continue;
+
+		for (const Mapping& mapping : list) {
+			if (mapping.node->id != node || page < mapping.file_page || page >= mapping.file_page + mapping.npages)
+				continue;
+
+			const uint16_t vpage = mapping.vpage + (page - mapping.file_page);
+			PageTableEntry& pte = (*process->page_table)[vpage];
+
+			if (pte[PteField::Present] && pte[PteField::PhyFrameID] == frame)
+				fn(process, vpage, pte);
+		}
+	}
+}
+
+// Pages written through the mapping become dirty in the page cache,
+// and are written back to the disk after they are unmapped.
+static void unmap (Process *process, const Mapping& mapping)
+{
+	for (uint32_t i = 0; i < mapping.npages; i++) {
+		PageTableEntry& pte = (*process->page_table)[mapping.vpage + i];
+
+		if (pte[PteField::Present] == 0)
+			continue;
+
+		if (pte[PteField::Dirty])
+			page_cache_mark_dirty(mapping.node->id, mapping.file_page + i);
+
+		process_unmap_page(process, mapping.vpage + i);
+	}
+
+	mapping.node->nhandles--;
+
+	writeback_kick();
+	node_close_if_unused(*mapping.node);
+}
+
+SyscallResult file_mmap (Process *process, const SyscallArgs& args)
+{
+	FileHandle *handle = get_handle(process, args.r1);
+
+	if (handle == nullptr || process->vmem_mode != VmemMode::Paging)
+		return syscall_error;
+
+	FileNode& node = *handle->node;
+	const uint16_t vaddr = args.r2;
+	const uint32_t npages = (static_cast<uint32_t>(args.r3) + Config::page_size - 1) / Config::page_size;
+	const uint32_t vpage = vaddr >> Config::page_size_bits;
+
+	if ((vaddr % Config::page_size) != 0 || (handle->pos % Config::page_size) != 0)
+		return syscall_error;
+
+	if (npages == 0 || vpage + npages > Config::ptes_per_table || handle->pos + args.r3 > node.size)
+		return syscall_error;
+
+	for (uint32_t i = vpage; i < vpage + npages; i++) {
+		if ((*process->page_table)[i][PteField::Present] || find_mapping(process, i) != nullptr)
+			return syscall_error;
+	}
+
+	// the mapping keeps the file open
+	node.nhandles++;
+
+	mappings[process->pid].push_back(Mapping {
+		.node = &node,
+		.vpage = static_cast<uint16_t>(vpage),
+		.npages = static_cast<uint16_t>(npages),
+		.file_page = static_cast<uint16_t>(handle->pos >> Config::page_size_bits)
+		});
+
+	return vaddr;
+}
+
+SyscallResult file_munmap (Process *process, const SyscallArgs& args)
+{
+	auto it = mappings.find(process->pid);
+
+	if (it == mappings.end())
+		return syscall_error;
+
+	auto& list = it->second;
+	const auto mapping = std::ranges::find(list, args.r1 >> Config::page_size_bits, &Mapping::vpage);
+
+	if ((args.r1 % Config::page_size) != 0 || mapping == list.end())
+		return syscall_error;
+
+	unmap(process, *mapping);
+	list.erase(mapping);
+
+	return 0;
+}
+
+bool file_handle_page_fault (Process *process, const uint16_t vaddr)
+{
+	const uint16_t vpage = vaddr >> Config::page_size_bits;
+	const Mapping *mapping = find_mapping(process, vpage);
+
+	if (mapping == nullptr)
+		return false;
+
+	FileNode& node = *mapping->node;
+	const uint16_t file_page = mapping->file_page + (vpage - mapping->vpage);
+	const uint32_t pos = file_page * Config::page_size;
+
+	if (const auto frame = page_cache_lookup(node.id, file_page)) {
+		frame_get(*frame);
+		process_map_page(process, vpage, *frame, true, true, false);
+		(*process->page_table)[vpage][PteSoftField::Shared] = 1;
+		return true;
+	}
+
+	if (node.read_error || pos >= node.size) {
+		node.read_error = false;
+		return false;
+	}
+
+	// The cpu retries the instruction when the process runs again,
+	// and then the page is in the cache.
+
+	if (!disk_is_busy()) {
+		// the rest of the mapping, as read-ahead
+		const uint32_t end = std::min<uint32_t>((mapping->file_page + mapping->npages) * Config::page_size, node.size);
+		const uint16_t size = std::min(end - pos, file_readahead_max);
+
+		const bool started = node.write_buffer.empty()
+			? start_read(node, pos, size, process->pid)
+			: start_flush(node, process->pid);
+
+		if (!started)
+			return false;
+	}
+
+	disk_wait.wait(process);
+
+	return true;
+}
+
+void file_mmap_fork (Process *parent, Process *child)
+{
+	const auto it = mappings.find(parent->pid);
+
+	if (it == mappings.end())
+		return;
+
+	const std::vector<Mapping> list = it->second;
+
+	for (const Mapping& mapping : list)
+		mapping.node->nhandles++;
+
+	mappings[child->pid] = list;
+}
+
+void file_mmap_release (Process *process)
+{
+	const auto it = mappings.find(process->pid);
+
+	if (it == mappings.end())
+		return;
+
+	for (const Mapping& mapping : it->second)
+		unmap(process, mapping);
+
+	mappings.erase(it);
+}
+
+bool file_mapped_page_accessed (const uint16_t node, const uint16_t page, const uint16_t frame)
+{
+	bool accessed = false;
+
+	for_each_mapped_pte(node, page, frame, [&accessed] (Process *process, const uint16_t vpage, PageTableEntry& pte) {
+		if (pte[PteField::Accessed]) {
+			pte[PteField::Accessed] = 0;
+			accessed = true;
+		}
+	});
+
+	return accessed;
+}
+
+void file_unmap_cached_page (const uint16_t node, const uint16_t page, const uint16_t frame)
+{
+	bool dirty = false;
+
+	for_each_mapped_pte(node, page, frame, [&dirty] (Process *process, const uint16_t vpage, PageTableEntry& pte) {
+		if (pte[PteField::Dirty])
+			dirty = true;
+
+		process_unmap_page(process, vpage);
+	});
+
+	if (dirty) {
+		page_cache_mark_dirty(node, page);
+		writeback_kick();
+	}
+}
+
+void file_release (Process *process)
+{
+	std::vector<FileNode*> closed;
+
+	for (auto it = handles.begin(); it != handles.end(); ) {
+		if (it->second.pid == process->pid) {
+			it->second.node->nhandles--;
+			closed.push_back(it->second.node);
+			it = handles.erase(it);
+		}
+		else
+			++it;
+	}
+
+	orphan_flush_kick();
+
+	for (FileNode *node : closed)
+		node_close_if_unused(*node);
+}
+
+// ---------------------------------------
+
+void file_disk_interrupt ()
+{
+	mylib_assert_exception(disk_request)
+
+	const DiskRequest request = *disk_request;
+	disk_request.reset();
+
+	// files are only closed while the disk is idle
+	FileNode& node = *request.node;
+
+	// nullptr if it was destroyed in the meantime
+	Process *process = process_get(request.pid);
+
+	if (request.type == DiskRequest::Type::Read) {
+		// reading the size makes the disk actually read the file
+		const uint16_t amount = cpu->read_io(IO_Port::DiskData);
+		std::vector<uint16_t> data(amount);
+
+		for (auto& v : data)
+			v = cpu->read_io(IO_Port::DiskData);
+
+		node.disk_pos = request.pos + amount;
+
+		if (process != nullptr)
+			process->stats.disk_read_bytes += amount;
+
+		// the file is shorter than we thought, it was changed by someone else
+		if (amount < request.size)
+			node.size = request.pos + amount;
+
+		for (uint32_t offset = 0; offset < amount; offset += Config::page_size) {
+			const uint16_t page = (request.pos + offset) >> Config::page_size_bits;
+
+			if (page_cache_lookup(node.id, page))
+				continue;
+
+			const auto frame = frame_alloc();
+
+			if (!frame) {
+				// Without the first page, the reader would miss forever,
+				// unless dirty pages free their frames once written back.
+				if (offset == 0 && !page_cache_first_dirty())
+					node.read_error = true;
+				break;
+			}
+
+			const uint32_t length = std::min<uint32_t>(Config::page_size, amount - offset);
+
+			frame_zero(*frame);
+
+			for (uint32_t i = 0; i < length; i++)
+				cpu->pmem_write(frame_to_paddr(*frame) + i, data[offset + i]);
+
+			page_cache_insert(node.id, page, *frame);
+		}
+	}
+	else {
+		if (disk_no_error()) {
+			node.disk_pos = request.pos + request.size;
+
+			if (process != nullptr)
+				process->stats.disk_write_bytes += request.size;
+		}
+		else {
+			node.write_error = true;
+			node.disk_pos = std::numeric_limits<uint32_t>::max(); // unknown, forces a seek
+		}
+
+		if (request.type == DiskRequest::Type::Write)
+			node.write_buffer.clear();
+		else
+			page_cache_mark_clean(node.id, request.pos >> Config::page_size_bits, request.generation);
+	}
+
+	node_close_if_unused(node);
+	orphan_flush_kick();
+	writeback_kick();
+
+	// the requester finds its data in the cache,
+	// the others compete for the disk again
+	disk_wait.wake_all();
+}
+
+// ---------------------------------------
+
+static FileNode* restore_node (const uint16_t id)
+{
+	const auto it = nodes_by_id.find(id);
+	mylib_assert_exception(it != nodes_by_id.end())
+	return it->second;
+}
+
+void file_save (Lib::SnapshotWriter& out)
+{
+	out.put_section("files");
+
+	out.put(next_node_id);
+	out.put<uint32_t>(nodes.size());
+
+	for (const auto& [fname, node] : nodes) {
+		out.put_string(fname);
+		out.put(node.id);
+		out.put(node.disk_id);
+		out.put(node.nhandles);
+		out.put(node.size);
+		out.put(node.disk_pos);
+		out.put_vector(node.write_buffer);
+		out.put(node.write_buffer_pos);
+		out.put(node.write_error);
+		out.put(node.read_error);
+	}
+
+	out.put(next_handle_id);
+	out.put<uint32_t>(handles.size());
+
+	for (const auto& [fid, handle] : handles) {
+		out.put(fid);
+		out.put(handle.node->id);
+		out.put(handle.pid);
+		out.put(handle.pos);
+		out.put(handle.readahead);
+		out.put(handle.last_read_end);
+	}
+
+	out.put<uint32_t>(mappings.size());
+
+	for (const auto& [pid, list] : mappings) {
+		out.put(pid);
+		out.put<uint32_t>(list.size());
+
+		for (const Mapping& mapping : list) {
+			out.put(mapping.node->id);
+			out.put(mapping.vpage);
+			out.put(mapping.npages);
+			out.put(mapping.file_page);
+		}
+	}
+
+	out.put(disk_request.has_value());
+
+	if (disk_request) {
+		out.put(disk_request->type);
+		out.put(disk_request->node->id);
+		out.put(disk_request->pos);
+		out.put(disk_request->size);
+		out.put(disk_request->pid);
+		out.put(disk_request->generation);
+	}
+
+	disk_wait.save(out);
+}
+
+void file_restore (Lib::SnapshotReader& in)
+{
+	in.expect_section("files");
+
+	nodes.clear();
+	nodes_by_id.clear();
+	handles.clear();
+	mappings.clear();
+	disk_request.reset();
+
+	next_node_id = in.get<uint16_t>();
+
+	const uint32_t nnodes = in.get<uint32_t>();
+
+	for (uint32_t i = 0; i < nnodes; i++) {
+		const std::string fname = in.get_string();
+
+		FileNode& node = nodes[fname];
+		node.id = in.get<uint16_t>();
+		node.disk_id = in.get<std::optional<uint16_t>>();
+		node.nhandles = in.get<uint32_t>();
+		node.size = in.get<uint32_t>();
+		node.disk_pos = in.get<uint32_t>();
+		node.write_buffer = in.get_vector<uint16_t>();
+		node.write_buffer_pos = in.get<uint32_t>();
+		node.write_error = in.get<bool>();
+		node.read_error = in.get<bool>();
+
+		nodes_by_id.insert(std::make_pair(node.id, &node));
+	}
+
+	next_handle_id = in.get<uint16_t>();
+
+	const uint32_t nhandles = in.get<uint32_t>();
+
+	for (uint32_t i = 0; i < nhandles; i++) {
+		const uint16_t fid = in.get<uint16_t>();
+
+		FileHandle handle;
+		handle.node = restore_node(in.get<uint16_t>());
+		handle.pid = in.get<uint16_t>();
+		handle.pos = in.get<uint32_t>();
+		handle.readahead = in.get<uint32_t>();
+		handle.last_read_end = in.get<uint32_t>();
+
+		handles.insert(std::make_pair(fid, handle));
+	}
+
+	const uint32_t nmapped = in.get<uint32_t>();
+
+	for (uint32_t i = 0; i < nmapped; i++) {
+		std::vector<Mapping>& list = mappings[in.get<uint16_t>()];
+		list.resize(in.get<uint32_t>());
+
+		for (Mapping& mapping : list) {
+			mapping.node = restore_node(in.get<uint16_t>());
+			mapping.vpage = in.get<uint16_t>();
+			mapping.npages = in.get<uint16_t>();
+			mapping.file_page = in.get<uint16_t>();
+		}
+	}
+
+	if (in.get<bool>()) {
+		DiskRequest request;
+		request.type = in.get<DiskRequest::Type>();
+		request.node = restore_node(in.get<uint16_t>());
+		request.pos = in.get<uint32_t>();
+		request.size = in.get<uint16_t>();
+		request.pid = in.get<uint16_t>();
+		request.generation = in.get<uint32_t>();
+
+		disk_request = request;
+	}
+
+	disk_wait.restore(in);
+}
+
+void file_reset ()
+{
+	nodes.clear();
+	nodes_by_id.clear();
+	next_node_id = 0;
+	handles.clear();
+	next_handle_id = 1;
+	mappings.clear();
+	disk_request.reset();
+	disk_wait.clear();
+}
+
+// ---------------------------------------
+
+} // end namespace
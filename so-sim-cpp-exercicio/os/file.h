@@ -0,0 +1,119 @@
+#ifndef __ARQSIM_HEADER_OS_FILE_H__
+#define __ARQSIM_HEADER_OS_FILE_H__
+
+#include <cstdint>
+
+#include <my-lib/std.h>
+#include <my-lib/macros.h>
+
+#include "../config.h"
+#include "../snapshot.h"
+#include "../arch/arch.h"
+#include "os.h"
+#include "syscall.h"
+
+namespace OS {
+
+// ---------------------------------------
+
+/*
+	Buffered file layer on top of the disk.
+
+	Every open returns a new file id with its own position, but processes
+	opening the same file share the disk file and its pages in the page
+	cache (see page-cache.h), so the data read by one is in memory for all.
+	A read served from the cache completes immediately; a miss reads at
+	least the current read-ahead size from the disk, which doubles on
+	sequential reads (up to file_readahead_max) and drops back to
+	file_readahead_min on a seek.
+
+	Writes update the cached pages and are collected in a write-behind
+	buffer, sent to the disk when it is full, on a cache miss, on close,
+	or when a write is not contiguous with the buffered data.
+
+	The disk handles one request at a time. Processes that need it, or
+	that wait for their request, block in a queue and restart the syscall
+	when the disk interrupts, so the data is then taken from the buffers.
+*/
+
+inline constexpr uint32_t file_readahead_min = 64;
+inline constexpr uint32_t file_readahead_max = 1024;
+inline constexpr uint32_t file_write_buffer_size = 512;
+
+struct Process;
+
+// r1 = vaddr of file name, r2 = length; returns file id
+SyscallResult file_open (Process *process, const SyscallArgs& args);
+
+// r1 = file id, r2 = vaddr, r3 = size; returns amount read, 0 at the end of the file
+SyscallResult file_read (Process *process, const SyscallArgs& args);
+
+// r1 = file id, r2 = vaddr, r3 = size; returns amount written
+SyscallResult file_write (Process *process, const SyscallArgs& args);
+
+// r1 = file id, r2 = position; returns the position
+SyscallResult file_seek (Process *process, const SyscallArgs& args);
+
+// r1 = file id; flushes the buffered writes
+SyscallResult file_close (Process *process, const SyscallArgs& args);
+
+// called by the interrupt handler when a disk request completes
+void file_disk_interrupt ();
+
+// closes the file ids of the process, called when it is destroyed
+void file_release (Process *process);
+
+// ---------------------------------------
+
+/*
+	Memory-mapped files.
+
+	mmap maps the file pages from the current position of the file id,
+	which must be page aligned, shared with the page cache and with every
+	other process that maps them. The pages are mapped on the first
+	access: the page fault takes the frame from the page cache, or blocks
+	the process while the disk reads the page and the rest of the mapping.
+	The page cache may take a mapped page back when memory is short, the
+	next access faults it in again. Pages written through a mapping are
+	written back after they are unmapped, by munmap, by the exit of the
+	process or by the page cache. Forked children share the mappings of
+	the parent.
+*/
+
+// r1 = file id, r2 = page aligned vaddr, r3 = size; returns vaddr
+SyscallResult file_mmap (Process *process, const SyscallArgs& args);
+
+// r1 = vaddr where the file was mapped
+SyscallResult file_munmap (Process *process, const SyscallArgs& args);
+
+// returns false if vaddr is not in a file mapping
+bool file_handle_page_fault (Process *process, const uint16_t vaddr);
+
+// the child shares the mappings of the parent, called after the page table is copied
+void file_mmap_fork (Process *parent, Process *child);
+
+// called when the process is destroyed, before its frames are released
+void file_mmap_release (Process *process);
+
+// For the clock of the page cache, on a page of the cache mapped by processes.
+// Returns if any mapping accessed the page since the last call, clearing the accessed bits.
+bool file_mapped_page_accessed (const uint16_t node, const uint16_t page, const uint16_t frame);
+
+// Unmaps the page from every mapping, the pages written through them
+// become dirty and are written back.
+void file_unmap_cached_page (const uint16_t node, const uint16_t page, const uint16_t frame);
+
+// ---------------------------------------
+
+// file nodes, file ids, mappings and the pending disk request
+void file_save (Lib::SnapshotWriter& out);
+void file_restore (Lib::SnapshotReader& in);
+
+// forgets the whole state, see OS::shutdown
+void file_reset ();
+
+// ---------------------------------------
+
+} // end namespace
+
+#endif
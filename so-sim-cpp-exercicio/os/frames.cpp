@@ -0,0 +1,158 @@
+#include <array>
+#include <vector>
+
+#include "../config.h"
+#include "../arch/arch.h"
+#include "os.h"
+#include "frames.h"
+#include "page-cache.h"
+
+namespace OS {
+
+// ---------------------------------------
+
+static thread_local std::array<uint16_t, nframes> refcounts;
+static thread_local std::vector<uint16_t> free_frames;
+
+// ---------------------------------------
+
+void frames_init ()
+{
+	free_frames.clear();
+	free_frames.reserve(nframes);
+
+	// pushed in reverse order, so that lower frames are allocated first
+	for (uint32_t i = nframes; i > 0; i--) {
+		refcounts[i-1] = 0;
+		free_frames.push_back(i-1);
+	}
+}
+
+std::optional<uint16_t> frame_alloc ()
+{
+	if (free_frames.empty() && page_cache_reclaim(page_cache_reclaim_batch) == 0)
+		return std::nullopt;
+
+	const uint16_t frame = free_frames.back();
+	free_frames.pop_back();
+
+	mylib_assert_exception(refcounts[frame] == 0)
+	refcounts[frame] = 1;
+
+	return frame;
+}
+
+static std::optional<uint16_t> find_contiguous (const uint32_t n)
+{
+	if (n > free_frames.size())
+		return std::nullopt;
+
+	uint32_t first = 0;
+	uint32_t length = 0;
+
+	for (uint32_t i = 0; i < nframes && length < n; i++) {
+		if (refcounts[i] == 0) {
+			if (length == 0)
+				first = i;
+			length++;
+		}
+		else
+			length = 0;
+	}
+
+	if (length < n)
+		return std::nullopt;
+
+	return first;
+}
+
+std::optional<uint16_t> frames_alloc_contiguous (const uint32_t n)
+{
+	if (n == 0)
+		return std::nullopt;
+
+	auto found = find_contiguous(n);
+
+	// the whole page cache may be in the way
+	if (!found && page_cache_reclaim(nframes) > 0)
+		found = find_contiguous(n);
+
+	if (!found)
+		return std::nullopt;
+
+	const uint32_t first = *found;
+
+	std::erase_if(free_frames, [first, n] (const uint16_t frame) {
+		return frame >= first && frame < first + n;
+	});
+
+	for (uint32_t i = first; i < first + n; i++)
+		refcounts[i] = 1;
+
+	return first;
+}
+
+void frame_get (const uint16_t frame)
+{
+	mylib_assert_exception(frame < nframes)
+	mylib_assert_exception(refcounts[frame] > 0)
+	refcounts[frame]++;
+}
+
+void frame_put (const uint16_t frame)
+{
+	mylib_assert_exception(frame < nframes)
+	mylib_assert_exception(refcounts[frame] > 0)
+
+	refcounts[frame]--;
+
+	if (refcounts[frame] == 0)
+		free_frames.push_back(frame);
+}
+
+uint16_t frame_refcount (const uint16_t frame)
+{
+	mylib_assert_exception(frame < nframes)
+	return refcounts[frame];
+}
+
+uint32_t frames_free_count ()
+{
+	return free_frames.size();
+}
+
+void frames_save (Lib::SnapshotWriter& out)
+{
+	out.put_section("frames");
+	out.put(refcounts);
+	out.put_vector(free_frames);
+}
+
+void frames_restore (Lib::SnapshotReader& in)
+{
+	in.expect_section("frames");
+	refcounts = in.get<decltype(refcounts)>();
+	free_frames = in.get_vector<uint16_t>();
+	free_frames.reserve(nframes);
+}
+
+void frame_copy (const uint16_t dest, const uint16_t src)
+{
+	const uint16_t paddr_dest = frame_to_paddr(dest);
+	const uint16_t paddr_src = frame_to_paddr(src);
+
+	for (uint16_t i = 0; i < Config::page_size; i++)
+		cpu->pmem_write(paddr_dest + i, cpu->pmem_read(paddr_src + i));
+}
+
+void frame_zero (const uint16_t frame)
+{
+	const uint16_t paddr = frame_to_paddr(frame);
+
+	for (uint16_t i = 0; i < Config::page_size; i++)
+		cpu->pmem_write(paddr + i, 0);
+}
+
+// ---------------------------------------
+
+} // end namespace
@@ -0,0 +1,57 @@
+#ifndef __ARQSIM_HEADER_OS_FRAMES_H__
+#define __ARQSIM_HEADER_OS_FRAMES_H__
+
+#include <optional>
+
+#include <cstdint>
+
+#include <my-lib/std.h>
+#include <my-lib/macros.h>
+
+#include "../config.h"
+#include "../snapshot.h"
+
+namespace OS {
+
+// ---------------------------------------
+
+// Physical page frame allocator.
+// Every frame has a reference count, so the same frame can be mapped
+// by several page tables (copy-on-write, shared code, ...).
+// The frame is released when the last reference is dropped.
+
+inline constexpr uint32_t nframes = Config::phys_mem_size_words / Config::page_size;
+
+void frames_init ();
+
+// Returns a frame with reference count 1, or std::nullopt if out of memory.
+// Unused page cache frames are reclaimed when there is no free frame.
+std::optional<uint16_t> frame_alloc ();
+
+// returns the first of n physically contiguous frames, each with
+// reference count 1, or std::nullopt if there is no such range
+std::optional<uint16_t> frames_alloc_contiguous (const uint32_t n);
+
+void frame_get (const uint16_t frame);
+void frame_put (const uint16_t frame);
+
+uint16_t frame_refcount (const uint16_t frame);
+uint32_t frames_free_count ();
+
+// the contents are in the memory snapshot
+void frames_save (Lib::SnapshotWriter& out);
+void frames_restore (Lib::SnapshotReader& in);
+
+void frame_copy (const uint16_t dest, const uint16_t src);
+void frame_zero (const uint16_t frame);
+
+inline constexpr uint16_t frame_to_paddr (const uint16_t frame)
+{
+	return frame << Config::page_size_bits;
+}
+
+// ---------------------------------------
+
+} // end namespace
+
+#endif
@@ -0,0 +1,183 @@
+#include <algorithm>
+#include <deque>
+#include <unordered_map>
+#include <vector>
+
+#include "../config.h"
+#include "../arch/arch.h"
+#include "os.h"
+#include "process.h"
+#include "syscall.h"
+#include "wait.h"
+#include "ipc.h"
+
+namespace OS {
+
+// ---------------------------------------
+
+struct Message {
+	uint16_t sender;
+	std::vector<uint16_t> data;
+};
+
+struct Mailbox {
+	std::deque<Message> messages;
+	WaitQueue receiver; // blocked in receive, waiting for a message
+	WaitQueue senders;  // blocked in send, waiting for room in the mailbox
+
+	// buffer of the blocked receiver
+	uint16_t recv_vaddr = 0;
+	uint16_t recv_max = 0;
+};
+
+// created on first use
+static thread_local std::unordered_map<uint16_t, Mailbox> mailboxes;
+
+// ---------------------------------------
+
+static void deliver (Process *receiver, const uint16_t sender_pid, const uint16_t size)
+{
+	process_set_gpr(receiver, 0, size);
+	process_set_gpr(receiver, 1, sender_pid);
+}
+
+// ---------------------------------------
+
+SyscallResult ipc_send (Process *process, const SyscallArgs& args)
+{
+	Process *dest = process_get(args.r1);
+
+	if (dest == nullptr || args.r3 > ipc_max_message_words)
+		return syscall_error;
+
+	Mailbox& mailbox = mailboxes[dest->pid];
+
+	if (dest->wait_queue == &mailbox.receiver) {
+		mylib_assert_exception(mailbox.messages.empty())
+
+		// a bad buffer of the sender is its own error, the receiver keeps waiting
+		if (!process_check_mem(process, args.r2, args.r3, false))
+			return syscall_error;
+
+		const uint16_t size = std::min(args.r3, mailbox.recv_max);
+
+		// the sender buffer is fine, so a failed copy is a bad buffer of the receiver,
+		// which loses the message and gets the error
+		if (process_copy_mem(dest, mailbox.recv_vaddr, process, args.r2, size))
+			deliver(dest, process->pid, size);
+		else
+			process_set_gpr(dest, 0, syscall_error);
+
+		mailbox.receiver.wake_one();
+
+		return args.r3;
+	}
+
+	if (mailbox.messages.size() >= ipc_mailbox_size)
+		return syscall_wait_and_restart(process, mailbox.senders);
+
+	Message message {
+		.sender = process->pid,
+		.data = std::vector<uint16_t>(args.r3)
+		};
+
+	if (!process_read_mem(process, args.r2, message.data))
+		return syscall_error;
+
+	mailbox.messages.push_back(std::move(message));
+
+	return args.r3;
+}
+
+SyscallResult ipc_receive (Process *process, const SyscallArgs& args)
+{
+	Mailbox& mailbox = mailboxes[process->pid];
+
+	if (mailbox.messages.empty()) {
+		mailbox.recv_vaddr = args.r1;
+		mailbox.recv_max = args.r2;
+		mailbox.receiver.wait(process);
+
+		// completed by the sender
+		return std::nullopt;
+	}
+
+	const Message& message = mailbox.messages.front();
+	const uint16_t size = std::min<uint16_t>(message.data.size(), args.r2);
+
+	if (!process_write_mem(process, args.r1, std::span(message.data).first(size)))
+		return syscall_error;
+
+	deliver(process, message.sender, size);
+	mailbox.messages.pop_front();
+	mailbox.senders.wake_one();
+
+	return std::nullopt;
+}
+
+void ipc_release (Process *process)
+{
+	const auto it = mailboxes.find(process->pid);
+
+	if (it == mailboxes.end())
+		return;
+
+	// they retry the send and get an error, since the receiver is gone
+	it->second.senders.wake_all();
+
+	mailboxes.erase(it);
+}
+
+void ipc_save (Lib::SnapshotWriter& out)
+{
+	out.put_section("ipc");
+	out.put<uint32_t>(mailboxes.size());
+
+	for (const auto& [pid, mailbox] : mailboxes) {
+		out.put(pid);
+		out.put<uint32_t>(mailbox.messages.size());
+
+		for (const Message& message : mailbox.messages) {
+			out.put(message.sender);
+			out.put_vector(message.data);
+		}
+
+		mailbox.receiver.save(out);
+		mailbox.senders.save(out);
+		out.put(mailbox.recv_vaddr);
+		out.put(mailbox.recv_max);
+	}
+}
+
+void ipc_restore (Lib::SnapshotReader& in)
+{
+	in.expect_section("ipc");
+	mailboxes.clear();
+
+	const uint32_t nmailboxes = in.get<uint32_t>();
+
+	for (uint32_t i = 0; i < nmailboxes; i++) {
+		Mailbox& mailbox = mailboxes[in.get<uint16_t>()];
+		const uint32_t nmessages = in.get<uint32_t>();
+
+		for (uint32_t j = 0; j < nmessages; j++) {
+			Message& message = mailbox.messages.emplace_back();
+			message.sender = in.get<uint16_t>();
+			message.data = in.get_vector<uint16_t>();
+		}
+
+		mailbox.receiver.restore(in);
+		mailbox.senders.restore(in);
+		mailbox.recv_vaddr = in.get<uint16_t>();
+		mailbox.recv_max = in.get<uint16_t>();
+	}
+}
+
+void ipc_reset ()
+{
+	mailboxes.clear();
+}
+
+// ---------------------------------------
+
+} // end namespace
@@ -0,0 +1,56 @@
+#ifndef __ARQSIM_HEADER_OS_IPC_H__
+#define __ARQSIM_HEADER_OS_IPC_H__
+
+#include <cstdint>
+
+#include <my-lib/std.h>
+#include <my-lib/macros.h>
+
+#include "../config.h"
+#include "../snapshot.h"
+#include "../arch/arch.h"
+#include "os.h"
+#include "syscall.h"
+
+namespace OS {
+
+// ---------------------------------------
+
+/*
+	Message passing between processes.
+
+	Every process has a mailbox with room for ipc_mailbox_size messages.
+	A sender blocks while the mailbox of the receiver is full.
+	If the receiver is already blocked in receive, the message is copied
+	straight from the address space of the sender to the one of the
+	receiver, without being buffered in the kernel. A bad buffer of the
+	sender fails the send, and a bad buffer of the receiver fails the
+	receive.
+*/
+
+inline constexpr uint32_t ipc_mailbox_size = 8;
+inline constexpr uint16_t ipc_max_message_words = 256;
+
+struct Process;
+
+// r1 = destination pid, r2 = vaddr, r3 = size; returns size
+SyscallResult ipc_send (Process *process, const SyscallArgs& args);
+
+// r1 = vaddr, r2 = max; blocks until a message arrives;
+// returns the amount copied in r0 and the sender pid in r1
+SyscallResult ipc_receive (Process *process, const SyscallArgs& args);
+
+// called when the process is destroyed, wakes up the processes waiting to send to it
+void ipc_release (Process *process);
+
+void ipc_save (Lib::SnapshotWriter& out);
+void ipc_restore (Lib::SnapshotReader& in);
+
+// forgets the whole state, see OS::shutdown
+void ipc_reset ();
+
+// ---------------------------------------
+
+} // end namespace
+
+#endif
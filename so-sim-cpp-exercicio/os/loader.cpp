@@ -0,0 +1,377 @@
+#include <algorithm>
+#include <filesystem>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "../config.h"
+#include "../lib.h"
+#include "../arch/arch.h"
+#include "os.h"
+#include "frames.h"
+#include "process.h"
+#include "loader.h"
+
+namespace OS {
+
+// ---------------------------------------
+
+using PteField = Arch::Cpu::PteField;
+
+struct Segment {
+	uint16_t vaddr;
+	uint32_t file_offset;  // first word in the image file
+	uint32_t file_words;   // words loaded from the file
+	uint32_t mem_words;    // file_words + zero-filled words
+	bool writable;
+	bool executable;
+};
+
+struct Image {
+	std::filesystem::file_time_type mtime;
+	std::vector<uint16_t> words;
+	std::vector<Segment> segments;
+	uint32_t mem_size; // end of the last segment
+
+	// vpage -> frame with the file contents of the page,
+	// shared by all paged processes running this image
+	std::map<uint16_t, uint16_t> frames;
+};
+
+static thread_local std::unordered_map<std::string, Image> cache;
+
+// ---------------------------------------
+
+static bool parse_segments (Image& image)
+{
+	const auto& words = image.words;
+
+	if (words.empty())
+		return false;
+
+	if (words[0] != image_magic) {
+		if (words.size() > Config::virtual_mem_size)
+			return false;
+
+		image.segments.push_back(Segment {
+			.vaddr = 0,
+			.file_offset = 0,
+			.file_words = static_cast<uint32_t>(words.size()),
+			.mem_words = static_cast<uint32_t>(words.size()),
+			.writable = true,
+			.executable = true
+			});
+
+		image.mem_size = words.size();
+
+		return true;
+	}
+
+	if (words.size() < image_header_words)
+		return false;
+
+	const uint32_t code_words = words[1];
+	const uint32_t data_vaddr = words[2];
+	const uint32_t data_words = words[3];
+	const uint32_t bss_words = words[4];
+
+	if (words.size() != image_header_words + code_words + data_words)
+		return false;
+
+	if ((data_vaddr % Config::page_size) != 0 || data_vaddr < code_words)
+		return false;
+
+	if (data_vaddr + data_words + bss_words > Config::virtual_mem_size)
+		return false;
+
+	image.segments.push_back(Segment {
+		.vaddr = 0,
+		.file_offset = image_header_words,
+		.file_words = code_words,
+		.mem_words = code_words,
+		.writable = false,
+		.executable = true
+		});
+
+	if (data_words + bss_words > 0) {
+		image.segments.push_back(Segment {
+			.vaddr = static_cast<uint16_t>(data_vaddr),
+			.file_offset = image_header_words + code_words,
+			.file_words = data_words,
+			.mem_words = data_words + bss_words,
+			.writable = true,
+			.executable = false
+			});
+	}
+
+	image.mem_size = data_vaddr + data_words + bss_words;
+
+	return true;
+}
+
+static void drop_image (Image& image)
+{
+	for (const auto& [vpage, frame] : image.frames)
+		frame_put(frame);
+
+	image.frames.clear();
+}
+
+// reads and parses the file, false if it is not a valid image
+static bool load_image_words (const std::string& fname, Image& image)
+{
+	try {
+		image.words = Lib::load_from_disk_to_16bit_buffer(fname);
+	}
+	catch (const std::exception& e) {
+		return false;
+	}
+
+	image.segments.clear();
+
+	return parse_segments(image);
+}
+
+// Returns the cached image, (re)loading it from the disk if the file changed.
+static Image* get_image (const std::string_view fname)
+{
+	std::error_code ec;
+	const auto mtime = std::filesystem::last_write_time(fname, ec);
+
+	if (ec)
+		return nullptr;
+
+	const std::string key(fname);
+	auto it = cache.find(key);
+
+	if (it != cache.end()) {
+		if (it->second.mtime == mtime)
+			return &it->second;
+
+		drop_image(it->second);
+		cache.erase(it);
+	}
+
+	Image image;
+	image.mtime = mtime;
+
+	// fname may point into a longer string, with no null at its end
+	if (!load_image_words(key, image))
+		return nullptr;
+
+	return &cache.insert(std::make_pair(key, std::move(image))).first->second;
+}
+
+// Writes the words of the segment that fall in [vaddr, vaddr + size) at paddr.
+static void copy_segment_words (const Image& image, const Segment& segment, const uint16_t vaddr, const uint32_t size, const uint16_t paddr)
+{
+	for (uint32_t i = 0; i < size; i++) {
+		const uint32_t offset = vaddr + i - segment.vaddr;
+
+		if (vaddr + i >= segment.vaddr && offset < segment.file_words)
+			cpu->pmem_write(paddr + i, image.words[segment.file_offset + offset]);
+	}
+}
+
+// ---------------------------------------
+
+static Process* load_base_limit (const std::string_view fname, Image& image, const uint16_t parent_pid)
+{
+	const uint32_t npages = (image.mem_size + Config::page_size - 1) / Config::page_size;
+	const auto first = frames_alloc_contiguous(npages);
+
+	if (!first)
+		return nullptr;
+
+	const uint16_t base = frame_to_paddr(*first);
+
+	for (uint32_t i = 0; i < npages; i++)
+		frame_zero(*first + i);
+
+	for (const Segment& segment : image.segments)
+		copy_segment_words(image, segment, segment.vaddr, segment.file_words, base + segment.vaddr);
+
+	Process *process = process_create(fname, parent_pid);
+
+	process->vmem_mode = VmemMode::BaseLimit;
+	process->vmem_paddr_base = base;
+	process->vmem_size = npages * Config::page_size;
+	process->page_table.reset();
+
+	return process;
+}
+
+// returns the frame holding the file contents of vpage, loading it if needed
+static std::optional<uint16_t> get_image_frame (Image& image, const Segment& segment, const uint16_t vpage)
+{
+	const auto it = image.frames.find(vpage);
+
+	if (it != image.frames.end())
+		return it->second;
+
+	const auto frame = frame_alloc();
+
+	if (!frame)
+		return std::nullopt;
+
+	frame_zero(*frame);
+	copy_segment_words(image, segment, vpage * Config::page_size, Config::page_size, frame_to_paddr(*frame));
+
+	image.frames.insert(std::make_pair(vpage, *frame));
+
+	return frame;
+}
+
+static Process* load_paging (const std::string_view fname, Image& image, const uint16_t parent_pid)
+{
+	Process *process = process_create(fname, parent_pid);
+
+	process->vmem_mode = VmemMode::Paging;
+
+	for (const Segment& segment : image.segments) {
+		const uint32_t first_vpage = segment.vaddr / Config::page_size;
+		const uint32_t file_end = segment.vaddr + segment.file_words;
+		const uint32_t mem_end = segment.vaddr + segment.mem_words;
+
+		for (uint32_t vpage = first_vpage; vpage * Config::page_size < mem_end; vpage++) {
+			if (vpage * Config::page_size < file_end) {
+				const auto frame = get_image_frame(image, segment, vpage);
+
+				if (!frame) {
+					process_destroy(process);
+					return nullptr;
+				}
+
+				frame_get(*frame);
+
+				// writable pages get a private copy on the first write
+				process_map_page(process, vpage, *frame, true, false, segment.executable);
+
+				if (segment.writable)
+					(*process->page_table)[vpage][PteSoftField::CopyOnWrite] = 1;
+			}
+			else {
+				const auto frame = frame_alloc();
+
+				if (!frame) {
+					process_destroy(process);
+					return nullptr;
+				}
+
+				frame_zero(*frame);
+				process_map_page(process, vpage, *frame, true, segment.writable, segment.executable);
+			}
+		}
+	}
+
+	return process;
+}
+
+// ---------------------------------------
+
+Process* load_program (const std::string_view fname, const VmemMode mode, const uint16_t parent_pid)
+{
+	mylib_assert_exception(mode == VmemMode::BaseLimit || mode == VmemMode::Paging)
+
+	// second try after releasing the unused cached images
+	for (uint32_t i = 0; i < 2; i++) {
+		Image *image = get_image(fname);
+
+		if (image == nullptr)
+			return nullptr;
+
+		Process *process = (mode == VmemMode::BaseLimit)
+			? load_base_limit(fname, *image, parent_pid)
+			: load_paging(fname, *image, parent_pid);
+
+		if (process != nullptr)
+			return process;
+
+		loader_cache_trim();
+	}
+
+	return nullptr;
+}
+
+void loader_cache_trim ()
+{
+	for (auto it = cache.begin(); it != cache.end(); ) {
+		Image& image = it->second;
+
+		const bool used = std::ranges::any_of(image.frames, [] (const auto& pair) {
+			return frame_refcount(pair.second) > 1;
+		});
+
+		if (used)
+			++it;
+		else {
+			drop_image(image);
+			it = cache.erase(it);
+		}
+	}
+}
+
+// ---------------------------------------
+
+// The words are not saved, they are read again from the files.
+// The frames keep the contents of the file when it was loaded, so an
+// image whose file changed since then is dropped by its next get_image.
+
+void loader_save (Lib::SnapshotWriter& out)
+{
+	out.put_section("loader");
+	out.put<uint32_t>(cache.size());
+
+	for (const auto& [fname, image] : cache) {
+		out.put_string(fname);
+		out.put<int64_t>(image.mtime.time_since_epoch().count());
+		out.put<uint32_t>(image.frames.size());
+
+		for (const auto& [vpage, frame] : image.frames) {
+			out.put(vpage);
+			out.put(frame);
+		}
+	}
+}
+
+void loader_restore (Lib::SnapshotReader& in)
+{
+	in.expect_section("loader");
+
+	// the references of the images are in the restored refcounts
+	cache.clear();
+
+	const uint32_t nimages = in.get<uint32_t>();
+
+	for (uint32_t i = 0; i < nimages; i++) {
+		const std::string fname = in.get_string();
+		Image& image = cache[fname];
+
+		image.mtime = std::filesystem::file_time_type(std::filesystem::file_time_type::duration(in.get<int64_t>()));
+
+		const uint32_t nframes_image = in.get<uint32_t>();
+
+		for (uint32_t j = 0; j < nframes_image; j++) {
+			const uint16_t vpage = in.get<uint16_t>();
+			image.frames[vpage] = in.get<uint16_t>();
+		}
+
+		std::error_code ec;
+		const auto mtime = std::filesystem::last_write_time(fname, ec);
+
+		// stale, get_image or loader_cache_trim release the frames
+		if (ec || mtime != image.mtime || !load_image_words(fname, image))
+			image.mtime = std::filesystem::file_time_type::min();
+	}
+}
+
+void loader_reset ()
+{
+	// the frames are reset by frames_init
+	cache.clear();
+}
+
+// ---------------------------------------
+
+} // end namespace
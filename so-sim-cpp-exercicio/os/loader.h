@@ -0,0 +1,64 @@
+#ifndef __ARQSIM_HEADER_OS_LOADER_H__
+#define __ARQSIM_HEADER_OS_LOADER_H__
+
+#include <string_view>
+
+#include <cstdint>
+
+#include <my-lib/std.h>
+#include <my-lib/macros.h>
+
+#include "../config.h"
+#include "../arch/arch.h"
+#include "os.h"
+
+namespace OS {
+
+// ---------------------------------------
+
+/*
+	Program images.
+
+	A plain image, as generated by the assembler, is a single segment
+	loaded at vaddr 0 and mapped readable, writable and executable.
+
+	An image may also start with a header that describes its segments:
+		word 0      image_magic
+		word 1      code size in words, loaded at vaddr 0, mapped R-X
+		word 2      data vaddr, page aligned and after the code
+		word 3      data size in words, mapped RW-
+		word 4      bss size in words, zero-filled after the data, mapped RW-
+	followed by the code words and then the data words.
+
+	image_magic decodes as an invalid instruction,
+	so a plain image never starts with it.
+*/
+
+inline constexpr uint16_t image_magic = 0x0FAB;
+inline constexpr uint32_t image_header_words = 5;
+
+inline constexpr VmemMode default_vmem_mode = VmemMode::Paging;
+
+struct Process;
+
+// Creates a process running the image, in a base/limit or paged address space.
+// Images are cached: paged processes running the same binary share the frames
+// of the code, and the data pages are shared copy-on-write.
+// Returns nullptr if the image is invalid or there is not enough memory.
+Process* load_program (const std::string_view fname, const VmemMode mode, const uint16_t parent_pid);
+
+// releases the cached images that no process is using
+void loader_cache_trim ();
+
+// the cached images hold references to their frames, so they are in the snapshot
+void loader_save (Lib::SnapshotWriter& out);
+void loader_restore (Lib::SnapshotReader& in);
+
+// forgets the whole state, see OS::shutdown
+void loader_reset ();
+
+// ---------------------------------------
+
+} // end namespace
+
+#endif
@@ -1,6 +1,9 @@
 #ifndef __ARQSIM_HEADER_OSLIB_H__
 #define __ARQSIM_HEADER_OSLIB_H__
 
+#include <algorithm>
+#include <limits>
+
 #include <cstdint>
 
 #include <my-lib/std.h>
@@ -55,6 +58,46 @@ void terminal_println (Arch::Cpu *cpu, const Terminal video, Types&&... vars)
 	terminal_print(cpu, video, vars..., '\n');
 }
 
+// reads the 4 words of a 64-bit io value, starting with the one that latches it
+inline uint64_t read_io_u64 (Arch::Cpu *cpu, const IO_Port word0)
+{
+	uint64_t value = 0;
+
+	for (uint16_t i = 0; i < 4; i++)
+		value |= static_cast<uint64_t>(cpu->read_io(std::to_underlying(word0) + i)) << (16 * i);
+
+	return value;
+}
+
+// a counter of the instruction mix, see Arch::Cpu::CounterIndex
+inline uint64_t cpu_read_counter (Arch::Cpu *cpu, const uint16_t index)
+{
+	cpu->write_io(IO_Port::CpuCounterSelect, index);
+	return read_io_u64(cpu, IO_Port::CpuCounter0);
+}
+
+// timer channels used by the kernel
+inline constexpr uint16_t timer_channel_quantum = 0;
+inline constexpr uint16_t timer_channel_sleep = 1;
+
+// intervals longer than 32 bits are clamped, the channel just fires earlier
+inline void timer_program_channel (Arch::Cpu *cpu, const uint16_t channel, const Arch::TimerMode mode, const uint64_t interval)
+{
+	const uint32_t cycles = std::min<uint64_t>(interval, std::numeric_limits<uint32_t>::max());
+
+	cpu->write_io(IO_Port::TimerChannelSelect, channel);
+	cpu->write_io(IO_Port::TimerChannelCycles0, cycles & 0xFFFF);
+	cpu->write_io(IO_Port::TimerChannelCycles1, cycles >> 16);
+	cpu->write_io(IO_Port::TimerChannelMode, std::to_underlying(mode));
+}
+
+// keeps the interval, restarting the count
+inline void timer_set_channel_mode (Arch::Cpu *cpu, const uint16_t channel, const Arch::TimerMode mode)
+{
+	cpu->write_io(IO_Port::TimerChannelSelect, channel);
+	cpu->write_io(IO_Port::TimerChannelMode, std::to_underlying(mode));
+}
+
 // ---------------------------------------
 
 } // end namespace
@@ -10,6 +10,16 @@
 #include "../arch/arch.h"
 #include "os.h"
 #include "os-lib.h"
+#include "frames.h"
+#include "page-cache.h"
+#include "process.h"
+#include "syscall.h"
+#include "wait.h"
+#include "loader.h"
+#include "file.h"
+#include "ipc.h"
+#include "shm.h"
+#include "command.h"
 
 
 namespace OS {
@@ -18,65 +28,151 @@ namespace OS {
 
 // ---------------------------------------
 
-Arch::Cpu *cpuTeste;
+thread_local Arch::Cpu *cpu = nullptr;
 
-void boot (Arch::Cpu *cpu)
+static constexpr std::string_view init_fname = "init.bin";
+
+// ---------------------------------------
+
+static void print_banners ()
 {
 	terminal_println(cpu, Arch::Terminal::Type::Command, "Type commands here");
 	terminal_println(cpu, Arch::Terminal::Type::App, "Apps output here");
 	terminal_println(cpu, Arch::Terminal::Type::Kernel, "Kernel output here");
-	cpuTeste=cpu;
+}
+
+void boot (Arch::Cpu *cpu_)
+{
+	cpu = cpu_;
+
+	print_banners();
+
+	frames_init();
+	command_init();
+
+	Process *init = load_program(init_fname, default_vmem_mode, invalid_pid);
+
+	if (init == nullptr)
+		terminal_println(cpu, Arch::Terminal::Type::Kernel, "cannot load ", init_fname);
+	else
+		sched_add(init);
+
+	schedule();
+}
+
+void shutdown ()
+{
+	syscall_reset();
+	shm_reset();
+	ipc_reset();
+	file_reset();
+	page_cache_reset();
+	sleep_queue_reset();
+	process_reset();
+	loader_reset();
+	frames_init();
+
+	cpu = nullptr;
 }
 
 // ---------------------------------------
 
-void interrupt (const Arch::InterruptCode interrupt)
-{	
+// Blocked processes are restored by the owners of the queues they
+// wait on, so processes come first. Screens are not in the snapshot.
 
-	// terminal_println(cpuTeste, Arch::Terminal::Type::Kernel, var);
-	Arch::Cpu ab = cpuTeste->read_io(interrupt)
-	
+void snapshot_save (Lib::SnapshotWriter& out)
+{
+	frames_save(out);
+	loader_save(out);
+	process_save(out);
+	sleep_queue_save(out);
+	page_cache_save(out);
+	file_save(out);
+	ipc_save(out);
+	shm_save(out);
+	syscall_save(out);
+}
+
+void snapshot_restore (Arch::Cpu *cpu_, Lib::SnapshotReader& in)
+{
+	cpu = cpu_;
+
+	frames_restore(in);
+	loader_restore(in);
+	process_restore(in);
+	sleep_queue_restore(in);
+	page_cache_restore(in);
+	file_restore(in);
+	ipc_restore(in);
+	shm_restore(in);
+	syscall_restore(in);
+
+	print_banners();
+	terminal_println(cpu, Arch::Terminal::Type::Kernel, "restored from snapshot");
+	command_init();
+}
+
+// ---------------------------------------
+
+void interrupt (const Arch::InterruptCode interrupt)
+{
 	if (interrupt == InterruptCode::Keyboard)
 	{
-		uint16_t var = cpuTeste->read_io(IO_Port::TerminalReadTypedChar);
+		command_keyboard_interrupt();
+		syscall_keyboard_interrupt();
+	}
+	else if (interrupt == InterruptCode::Disk) {
+		file_disk_interrupt();
+	}
+	else if (interrupt == InterruptCode::Timer) {
+		const uint16_t fired = cpu->read_io(IO_Port::TimerFiredChannels);
+
+		if (fired & (1 << timer_channel_sleep))
+			sleep_queue_tick(read_io_u64(cpu, IO_Port::TimerCycles0));
+
+		if ((fired & (1 << timer_channel_quantum)) && process_current() != nullptr && sched_is_preemptive())
+			schedule();
 	}
-	if(interrupt == Arch::InterruptCode::CpuException){
-		const Arch::Cpu::CpuException& exception = cpuTeste->get_ref_cpu_exception();
+	else if(interrupt == Arch::InterruptCode::CpuException){
+		const Arch::Cpu::CpuException& exception = cpu->get_ref_cpu_exception();
+
+		if (process_current() == nullptr)
+			mylib_throw_exception_msg("cpu exception with no running process: ", exception.type);
+
+		process_current()->stats.faults[ std::to_underlying(exception.type) ]++;
+
 		switch (exception.type)
 		{
 		case Arch::Cpu::CpuException::Type::VmemGPFnotReadable:
-			terminal_println(cpuTeste, Arch::Terminal::Type::Kernel, "GPF: memória não legível.");
+			process_kill(process_current(), "GPF: memória não legível.");
 			break;
 
 		case Arch::Cpu::CpuException::Type::VmemGPFnotWritable:
-			terminal_println(cpuTeste, Arch::Terminal::Type::Kernel, "GPF: memória não gravável.");
+			if (!process_handle_cow_fault(process_current(), exception.vaddr))
+				process_kill(process_current(), "GPF: memória não gravável.");
 			break;
 
 		case Arch::Cpu::CpuException::Type::VmemGPFnotExecutable:
-			terminal_println(cpuTeste, Arch::Terminal::Type::Kernel, "GPF: memória não executável.");
+			process_kill(process_current(), "GPF: memória não executável.");
 			break;
 
 		case Arch::Cpu::CpuException::Type::GPFinvalidInstruction:
-			terminal_println(cpuTeste, Arch::Terminal::Type::Kernel, "GPF: instrução inválida.");
+			process_kill(process_current(), "GPF: instrução inválida.");
 			break;
 
 		case Arch::Cpu::CpuException::Type::VmemPageFault:
-			terminal_println(cpuTeste, Arch::Terminal::Type::Kernel, "Exceção: Page Fault.");
+			if (!file_handle_page_fault(process_current(), exception.vaddr))
+				process_kill(process_current(), "Exceção: Page Fault.");
 			break;
 
 		default:
-			terminal_println(cpuTeste, Arch::Terminal::Type::Kernel, "Exceção desconhecida.");
+			process_kill(process_current(), "Exceção desconhecida.");
 			break;
 		}
 	}
-	
-}
-
-// ---------------------------------------
-
-void syscall ()
-{
 
+	if (process_current() == nullptr)
+		schedule();
 }
 
 // ---------------------------------------
@@ -7,6 +7,7 @@
 #include <my-lib/macros.h>
 
 #include "../config.h"
+#include "../snapshot.h"
 #include "../arch/arch.h"
 
 namespace OS {
@@ -26,8 +27,67 @@ using DiskError = Arch::Disk::Error;
 
 // ---------------------------------------
 
+/*
+	Syscall ABI:
+		r0          syscall number
+		r1..r3      arguments
+		r0          result, syscall_error on failure
+
+	Strings and buffers in guest memory store one char/byte per word.
+*/
+
+enum class Syscall : uint16_t {
+	Exit          = 0,   // r1 = exit code
+	Fork          = 1,   // returns child pid to the parent, 0 to the child
+	PrintStr      = 2,   // r1 = vaddr, r2 = length; returns amount printed
+	ReadChar      = 3,   // blocks until a key is typed; returns the char
+	OpenFile      = 4,   // r1 = vaddr of file name, r2 = length; returns file id
+	ReadFile      = 5,   // r1 = file id, r2 = vaddr, r3 = size; returns amount read, 0 at the end
+	CloseFile     = 6,   // r1 = file id
+	Yield         = 7,
+	Sleep         = 8,   // r1 = amount of timer ticks (quantum intervals)
+	GetTime       = 9,   // returns time in seconds
+	Spawn         = 10,  // r1 = vaddr of program file name, r2 = length; returns pid
+	ReadStr       = 11,  // r1 = vaddr, r2 = max; blocks until a key is typed; returns amount read
+	Send          = 12,  // r1 = pid, r2 = vaddr, r3 = size; blocks while the mailbox is full; returns size
+	Receive       = 13,  // r1 = vaddr, r2 = max; blocks until a message arrives; returns amount read, r1 = sender pid
+
+	ShmGet        = 14,  // r1 = key, r2 = size; creates the segment if needed; returns the key
+	ShmAttach     = 15,  // r1 = key, r2 = page aligned vaddr, r3 = ShmFlags; returns the segment size
+	ShmDetach     = 16,  // r1 = vaddr of the attached segment
+
+	WriteFile     = 17,  // r1 = file id, r2 = vaddr, r3 = size; returns amount written
+	SeekFile      = 18,  // r1 = file id, r2 = position; returns the position
+
+	Mmap          = 19,  // r1 = file id, r2 = page aligned vaddr, r3 = size; maps from the file position; returns vaddr
+	Munmap        = 20,  // r1 = vaddr of the mapping
+
+	GetCycles     = 21,  // r1 = vaddr of 4 words, receives the 64-bit cycle counter, low word first
+	GetTimeUs     = 22,  // r1 = vaddr of 4 words, receives the 64-bit microseconds since power on, low word first
+
+	Count         = 23 // amount of syscalls
+};
+
+inline constexpr uint16_t syscall_error = 0xFFFF;
+
+// ---------------------------------------
+
+// Set at boot. The kernel state, this and the module variables, is per
+// host thread, so that each thread can run its own machine. A thread
+// must call shutdown before it boots or restores another machine.
+extern thread_local Arch::Cpu *cpu;
+
 void boot (Arch::Cpu *cpu);
 
+// Forgets the kernel state of the machine run by this thread, which
+// must not run anymore. Its memory is not touched.
+void shutdown ();
+
+// Kernel part of a machine snapshot, see Arch::Computer::save_snapshot.
+// snapshot_restore is used instead of boot.
+void snapshot_save (Lib::SnapshotWriter& out);
+void snapshot_restore (Arch::Cpu *cpu, Lib::SnapshotReader& in);
+
 void interrupt (const InterruptCode interrupt);
 
 void syscall ();
@@ -0,0 +1,233 @@
+#include <iterator>
+#include <list>
+#include <map>
+#include <unordered_map>
+
+#include "../config.h"
+#include "../arch/arch.h"
+#include "os.h"
+#include "frames.h"
+#include "page-cache.h"
+#include "file.h"
+
+namespace OS {
+
+// ---------------------------------------
+
+struct CachedPage {
+	uint16_t node;
+	uint16_t page;
+	uint16_t frame;
+	bool referenced; // second chance of the clock
+};
+
+static constexpr uint32_t make_key (const uint16_t node, const uint16_t page)
+{
+	return (static_cast<uint32_t>(node) << 16) | page;
+}
+
+// the list is the clock, hand points to the next candidate for eviction
+static thread_local std::list<CachedPage> pages;
+static thread_local std::list<CachedPage>::iterator hand = pages.end();
+static thread_local std::unordered_map<uint32_t, std::list<CachedPage>::iterator> index;
+static thread_local std::map<uint32_t, uint32_t> dirty; // generation by key, ordered, so the pages of a node are together
+static thread_local uint32_t next_generation = 0;
+
+// ---------------------------------------
+
+static std::list<CachedPage>::iterator evict (const std::list<CachedPage>::iterator it)
+{
+	frame_put(it->frame);
+	index.erase(make_key(it->node, it->page));
+	dirty.erase(make_key(it->node, it->page));
+
+	const auto next = pages.erase(it);
+
+	return next;
+}
+
+// ---------------------------------------
+
+std::optional<uint16_t> page_cache_lookup (const uint16_t node, const uint16_t page)
+{
+	const auto it = index.find(make_key(node, page));
+
+	if (it == index.end())
+		return std::nullopt;
+
+	it->second->referenced = true;
+
+	return it->second->frame;
+}
+
+void page_cache_insert (const uint16_t node, const uint16_t page, const uint16_t frame)
+{
+	const uint32_t key = make_key(node, page);
+
+	mylib_assert_exception(!index.contains(key))
+
+	// behind the hand, so it is the last one the clock looks at
+	const auto it = pages.insert(hand, CachedPage {
+		.node = node,
+		.page = page,
+		.frame = frame,
+		.referenced = true
+		});
+
+	index.insert(std::make_pair(key, it));
+}
+
+void page_cache_drop (const uint16_t node)
+{
+	for (auto it = pages.begin(); it != pages.end(); ) {
+		if (it->node != node)
+			++it;
+		else if (it == hand)
+			it = hand = evict(it);
+		else
+			it = evict(it);
+	}
+}
+
+uint32_t page_cache_reclaim (const uint32_t n)
+{
+	uint32_t evicted = 0;
+
+	// two full turns: the first one may only clear the referenced bits
+	for (uint32_t steps = 2 * pages.size(); steps > 0 && evicted < n && !pages.empty(); steps--) {
+		if (hand == pages.end())
+			hand = pages.begin();
+
+		const uint32_t key = make_key(hand->node, hand->page);
+		const bool mapped = frame_refcount(hand->frame) > 1;
+
+		// file mappings are the only other users of the frames of the cache
+		if (dirty.contains(key))
+			++hand;
+		else if (hand->referenced || (mapped && file_mapped_page_accessed(hand->node, hand->page, hand->frame))) {
+			hand->referenced = false;
+			++hand;
+		}
+		else {
+			if (mapped)
+				file_unmap_cached_page(hand->node, hand->page, hand->frame);
+
+			// written through a mapping, it is evicted after the write-back
+			if (frame_refcount(hand->frame) > 1 || dirty.contains(key))
+				++hand;
+			else {
+				hand = evict(hand);
+				evicted++;
+			}
+		}
+	}
+
+	return evicted;
+}
+
+void page_cache_mark_dirty (const uint16_t node, const uint16_t page)
+{
+	const uint32_t key = make_key(node, page);
+
+	mylib_assert_exception(index.contains(key))
+
+	dirty[key] = next_generation++;
+}
+
+void page_cache_mark_clean (const uint16_t node, const uint16_t page, const uint32_t generation)
+{
+	const auto it = dirty.find(make_key(node, page));
+
+	if (it != dirty.end() && it->second == generation)
+		dirty.erase(it);
+}
+
+bool page_cache_has_dirty (const uint16_t node)
+{
+	const auto it = dirty.lower_bound(make_key(node, 0));
+	return it != dirty.end() && (it->first >> 16) == node;
+}
+
+std::optional<PageCacheDirtyPage> page_cache_first_dirty ()
+{
+	if (dirty.empty())
+		return std::nullopt;
+
+	const auto& [key, generation] = *dirty.begin();
+	const auto& page = *index.at(key);
+
+	return PageCacheDirtyPage {
+		.node = page.node,
+		.page = page.page,
+		.frame = page.frame,
+		.generation = generation
+		};
+}
+
+uint32_t page_cache_size ()
+{
+	return pages.size();
+}
+
+void page_cache_save (Lib::SnapshotWriter& out)
+{
+	out.put_section("page-cache");
+	out.put<uint32_t>(pages.size());
+
+	for (const CachedPage& page : pages)
+		out.put(page);
+
+	out.put<uint32_t>(std::distance(pages.begin(), hand));
+	out.put<uint32_t>(dirty.size());
+
+	for (const auto& [key, generation] : dirty) {
+		out.put(key);
+		out.put(generation);
+	}
+
+	out.put(next_generation);
+}
+
+void page_cache_restore (Lib::SnapshotReader& in)
+{
+	in.expect_section("page-cache");
+
+	pages.clear();
+	index.clear();
+
+	const uint32_t npages = in.get<uint32_t>();
+
+	for (uint32_t i = 0; i < npages; i++) {
+		const CachedPage page = in.get<CachedPage>();
+		const auto it = pages.insert(pages.end(), page);
+		index.insert(std::make_pair(make_key(page.node, page.page), it));
+	}
+
+	const uint32_t hand_pos = in.get<uint32_t>();
+	mylib_assert_exception(hand_pos <= pages.size())
+	hand = std::next(pages.begin(), hand_pos);
+
+	dirty.clear();
+
+	const uint32_t ndirty = in.get<uint32_t>();
+
+	for (uint32_t i = 0; i < ndirty; i++) {
+		const uint32_t key = in.get<uint32_t>();
+		dirty[key] = in.get<uint32_t>();
+	}
+
+	next_generation = in.get<uint32_t>();
+}
+
+void page_cache_reset ()
+{
+	pages.clear();
+	hand = pages.end();
+	index.clear();
+	dirty.clear();
+	next_generation = 0;
+}
+
+// ---------------------------------------
+
+} // end namespace
@@ -0,0 +1,78 @@
+#ifndef __ARQSIM_HEADER_OS_PAGE_CACHE_H__
+#define __ARQSIM_HEADER_OS_PAGE_CACHE_H__
+
+#include <optional>
+
+#include <cstdint>
+
+#include <my-lib/std.h>
+#include <my-lib/macros.h>
+
+#include "../config.h"
+#include "../snapshot.h"
+#include "os.h"
+
+namespace OS {
+
+// ---------------------------------------
+
+/*
+	Page cache, file contents kept in frames and indexed by
+	(file node, page number), shared by every process that reads the file.
+
+	The cache holds one reference to each of its frames. Pages are evicted
+	with the clock algorithm when the frame allocator runs out of memory.
+	Pages mapped by processes get their second chance from the accessed
+	bits of the page tables, and are unmapped before they are evicted,
+	becoming dirty in the cache if they were written through the mapping.
+	Dirty pages are kept until they are written back and marked clean.
+	Each time a page is marked dirty it gets a new generation, and marking
+	it clean only works with the generation that was written back, so a
+	page dirtied again during its write-back stays dirty.
+*/
+
+inline constexpr uint32_t page_cache_reclaim_batch = 16;
+
+// returns the frame caching the page and marks it as recently used
+std::optional<uint16_t> page_cache_lookup (const uint16_t node, const uint16_t page);
+
+// the cache takes over the caller's reference to the frame
+void page_cache_insert (const uint16_t node, const uint16_t page, const uint16_t frame);
+
+// removes every page of the node from the cache
+void page_cache_drop (const uint16_t node);
+
+void page_cache_mark_dirty (const uint16_t node, const uint16_t page);
+
+// does nothing if the page was marked dirty again after generation
+void page_cache_mark_clean (const uint16_t node, const uint16_t page, const uint32_t generation);
+
+bool page_cache_has_dirty (const uint16_t node);
+
+struct PageCacheDirtyPage {
+	uint16_t node;
+	uint16_t page;
+	uint16_t frame;
+	uint32_t generation;
+};
+
+// returns any dirty page, to be written back
+std::optional<PageCacheDirtyPage> page_cache_first_dirty ();
+
+// evicts up to n pages that only the cache references, returns how many were evicted
+uint32_t page_cache_reclaim (const uint32_t n);
+
+uint32_t page_cache_size ();
+
+// keeps the clock order and the position of the hand
+void page_cache_save (Lib::SnapshotWriter& out);
+void page_cache_restore (Lib::SnapshotReader& in);
+
+// forgets the whole state, see OS::shutdown
+void page_cache_reset ();
+
+// ---------------------------------------
+
+} // end namespace
+
+#endif
@@ -0,0 +1,642 @@
+#include <list>
+#include <unordered_map>
+#include <algorithm>
+
+#include "../config.h"
+#include "../arch/arch.h"
+#include "os.h"
+#include "os-lib.h"
+#include "frames.h"
+#include "process.h"
+#include "wait.h"
+#include "ipc.h"
+#include "shm.h"
+#include "file.h"
+
+namespace OS {
+
+// ---------------------------------------
+
+using PteField = Arch::Cpu::PteField;
+
+static thread_local std::unordered_map<uint16_t, std::unique_ptr<Process>> processes;
+static thread_local std::list<Process*> ready_queue;
+static thread_local Process *current = nullptr;
+static thread_local uint16_t next_pid = 1;
+static thread_local bool preemptive = true;
+static thread_local bool quantum_timer_on = true; // periodic since power on
+
+// ---------------------------------------
+
+// Tickless: the quantum timer only runs while another process
+// is waiting for the cpu, otherwise there is nothing to preempt.
+static void sched_update_quantum_timer (const bool restart)
+{
+	const bool needed = preemptive && (current != nullptr) && !ready_queue.empty();
+
+	if (needed && (restart || !quantum_timer_on))
+		timer_set_channel_mode(cpu, timer_channel_quantum, Arch::TimerMode::Periodic);
+	else if (!needed && quantum_timer_on)
+		timer_set_channel_mode(cpu, timer_channel_quantum, Arch::TimerMode::Off);
+
+	quantum_timer_on = needed;
+}
+
+// ---------------------------------------
+
+static void account (Process *process)
+{
+	process->stats.cycles += cpu->get_busy_cycles() - process->accounted_cycles;
+	process->stats.instructions += cpu->get_instructions_retired() - process->accounted_instructions;
+
+	process->accounted_cycles = cpu->get_busy_cycles();
+	process->accounted_instructions = cpu->get_instructions_retired();
+}
+
+static void context_save (Process *process)
+{
+	account(process);
+
+	for (uint32_t i = 0; i < Config::nregs; i++)
+		process->gprs[i] = cpu->get_gpr(i);
+
+	process->pc = cpu->get_pc();
+}
+
+static void context_restore (Process *process)
+{
+	for (uint32_t i = 0; i < Config::nregs; i++)
+		cpu->set_gpr(i, process->gprs[i]);
+
+	cpu->set_pc(process->pc);
+	cpu->set_vmem_mode(process->vmem_mode);
+	cpu->set_vmem_paddr_base(process->vmem_paddr_base);
+	cpu->set_vmem_size(process->vmem_size);
+	cpu->set_page_table(process->page_table.get());
+	cpu->set_context_id(process->pid);
+
+	Arch::Computer& computer = cpu->get_computer();
+	computer.get_event_trace().begin_context(computer.get_cycle(), process->pid);
+
+	process->accounted_cycles = cpu->get_busy_cycles();
+	process->accounted_instructions = cpu->get_instructions_retired();
+}
+
+// ---------------------------------------
+
+Process* process_create (const std::string_view name, const uint16_t parent_pid)
+{
+	while (processes.contains(next_pid) || next_pid == invalid_pid || next_pid == 0)
+		next_pid++;
+
+	auto process = std::make_unique<Process>();
+	process->pid = next_pid++;
+	process->parent_pid = parent_pid;
+	process->name = name;
+	process->page_table = std::make_unique<PageTable>();
+
+	Process *ptr = process.get();
+	processes.insert(std::make_pair(ptr->pid, std::move(process)));
+
+	return ptr;
+}
+
+void process_destroy (Process *process)
+{
+	// detaches before the remaining pages are released
+	shm_release(process);
+	file_mmap_release(process);
+	file_release(process);
+
+	if (process->vmem_mode == VmemMode::BaseLimit) {
+		const uint16_t first = process->vmem_paddr_base >> Config::page_size_bits;
+
+		for (uint32_t i = 0; i < process->vmem_size / Config::page_size; i++)
+			frame_put(first + i);
+	}
+	else if (process->page_table) {
+		for (auto& pte: *process->page_table) {
+			if (pte[PteField::Present])
+				frame_put(pte[PteField::PhyFrameID]);
+		}
+	}
+
+	wait_cancel(process);
+	ipc_release(process);
+	ready_queue.remove(process);
+
+	if (current == process)
+		current = nullptr;
+
+	processes.erase(process->pid);
+}
+
+void process_kill (Process *process, const std::string_view reason)
+{
+	const bool running = (process == current);
+
+	terminal_println(cpu, Arch::Terminal::Type::Kernel, "process ", process->pid, " killed: ", reason);
+
+	process_destroy(process);
+
+	if (running)
+		schedule();
+}
+
+Process* process_get (const uint16_t pid)
+{
+	const auto it = processes.find(pid);
+	return (it == processes.end()) ? nullptr : it->second.get();
+}
+
+Process* process_current ()
+{
+	return current;
+}
+
+std::vector<Process*> process_list ()
+{
+	std::vector<Process*> list;
+	list.reserve(processes.size());
+
+	for (const auto& [pid, process] : processes)
+		list.push_back(process.get());
+
+	std::ranges::sort(list, {}, &Process::pid);
+
+	return list;
+}
+
+void process_account_current ()
+{
+	if (current != nullptr)
+		account(current);
+}
+
+void process_set_gpr (Process *process, const uint8_t code, const uint16_t value)
+{
+	if (process == current)
+		cpu->set_gpr(code, value);
+	else
+		process->gprs[code] = value;
+}
+
+void process_map_page (Process *process, const uint16_t vpage, const uint16_t frame, const bool readable, const bool writable, const bool executable)
+{
+	mylib_assert_exception(process->page_table)
+	mylib_assert_exception(vpage < Config::ptes_per_table)
+
+	PageTableEntry& pte = (*process->page_table)[vpage];
+
+	mylib_assert_exception(pte[PteField::Present] == 0)
+
+	pte = 0;
+	pte[PteField::PhyFrameID] = frame;
+	pte[PteField::Present] = 1;
+	pte[PteField::Readable] = readable;
+	pte[PteField::Writable] = writable;
+	pte[PteField::Executable] = executable;
+}
+
+void process_unmap_page (Process *process, const uint16_t vpage)
+{
+	mylib_assert_exception(process->page_table)
+	mylib_assert_exception(vpage < Config::ptes_per_table)
+
+	PageTableEntry& pte = (*process->page_table)[vpage];
+
+	mylib_assert_exception(pte[PteField::Present] == 1)
+
+	frame_put(pte[PteField::PhyFrameID]);
+	pte = 0;
+}
+
+bool process_translate (Process *process, const uint16_t vaddr, const bool write, uint16_t& paddr, uint32_t& length)
+{
+	switch (process->vmem_mode) {
+		case VmemMode::Disabled:
+			if (vaddr >= cpu->get_pmem_size_words())
+				return false;
+			paddr = vaddr;
+			length = cpu->get_pmem_size_words() - vaddr;
+		break;
+
+		case VmemMode::BaseLimit:
+			if (vaddr >= process->vmem_size)
+				return false;
+			paddr = process->vmem_paddr_base + vaddr;
+			length = process->vmem_size - vaddr;
+		break;
+
+		case VmemMode::Paging: {
+			PageTableEntry& pte = (*process->page_table)[vaddr >> Config::page_size_bits];
+
+			if (pte[PteField::Present] == 0)
+				return false;
+
+			if (write) {
+				if (pte[PteField::Writable] == 0 && !process_handle_cow_fault(process, vaddr))
+					return false;
+				pte[PteField::Dirty] = 1;
+			}
+			else if (pte[PteField::Readable] == 0)
+				return false;
+
+			pte[PteField::Accessed] = 1;
+
+			const uint16_t offset = vaddr & (Config::page_size - 1);
+			paddr = frame_to_paddr(pte[PteField::PhyFrameID]) + offset;
+			length = Config::page_size - offset;
+		}
+		break;
+
+		default:
+			return false;
+	}
+
+	return true;
+}
+
+bool process_read_mem (Process *process, const uint16_t vaddr, std::span<uint16_t> buffer)
+{
+	if (vaddr + buffer.size() > Config::virtual_mem_size)
+		return false;
+
+	uint32_t done = 0;
+
+	while (done < buffer.size()) {
+		uint16_t paddr;
+		uint32_t length;
+
+		if (!process_translate(process, vaddr + done, false, paddr, length))
+			return false;
+
+		length = std::min<uint32_t>(length, buffer.size() - done);
+
+		for (uint32_t i = 0; i < length; i++)
+			buffer[done + i] = cpu->pmem_read(paddr + i);
+
+		done += length;
+	}
+
+	return true;
+}
+
+bool process_write_mem (Process *process, const uint16_t vaddr, std::span<const uint16_t> buffer)
+{
+	if (vaddr + buffer.size() > Config::virtual_mem_size)
+		return false;
+
+	uint32_t done = 0;
+
+	while (done < buffer.size()) {
+		uint16_t paddr;
+		uint32_t length;
+
+		if (!process_translate(process, vaddr + done, true, paddr, length))
+			return false;
+
+		length = std::min<uint32_t>(length, buffer.size() - done);
+
+		for (uint32_t i = 0; i < length; i++)
+			cpu->pmem_write(paddr + i, buffer[done + i]);
+
+		done += length;
+	}
+
+	return true;
+}
+
+bool process_check_mem (Process *process, const uint16_t vaddr, const uint32_t size, const bool write)
+{
+	if (vaddr + size > Config::virtual_mem_size)
+		return false;
+
+	uint32_t done = 0;
+
+	while (done < size) {
+		uint16_t paddr;
+		uint32_t length;
+
+		if (!process_translate(process, vaddr + done, write, paddr, length))
+			return false;
+
+		done += std::min(length, size - done);
+	}
+
+	return true;
+}
+
+bool process_copy_mem (Process *dest, const uint16_t dest_vaddr, Process *src, const uint16_t src_vaddr, const uint32_t size)
+{
+	if (dest_vaddr + size > Config::virtual_mem_size || src_vaddr + size > Config::virtual_mem_size)
+		return false;
+
+	uint32_t done = 0;
+
+	while (done < size) {
+		uint16_t dest_paddr, src_paddr;
+		uint32_t dest_length, src_length;
+
+		if (!process_translate(src, src_vaddr + done, false, src_paddr, src_length))
+			return false;
+
+		if (!process_translate(dest, dest_vaddr + done, true, dest_paddr, dest_length))
+			return false;
+
+		const uint32_t length = std::min({ dest_length, src_length, size - done });
+
+		for (uint32_t i = 0; i < length; i++)
+			cpu->pmem_write(dest_paddr + i, cpu->pmem_read(src_paddr + i));
+
+		done += length;
+	}
+
+	return true;
+}
+
+// Base/limit address spaces cannot share frames, so they are copied.
+static Process* fork_base_limit (Process *parent)
+{
+	const uint32_t npages = parent->vmem_size / Config::page_size;
+	const auto first = frames_alloc_contiguous(npages);
+
+	if (!first)
+		return nullptr;
+
+	const uint16_t parent_first = parent->vmem_paddr_base >> Config::page_size_bits;
+
+	for (uint32_t i = 0; i < npages; i++)
+		frame_copy(*first + i, parent_first + i);
+
+	Process *child = process_create(parent->name, parent->pid);
+
+	child->vmem_mode = VmemMode::BaseLimit;
+	child->vmem_paddr_base = frame_to_paddr(*first);
+	child->vmem_size = parent->vmem_size;
+	child->page_table.reset();
+
+	return child;
+}
+
+static Process* fork_paging (Process *parent)
+{
+	Process *child = process_create(parent->name, parent->pid);
+
+	child->vmem_mode = VmemMode::Paging;
+
+	// Share every frame with the child.
+	// Writable pages become read-only in both tables and are copied
+	// on the first write, in process_handle_cow_fault.
+
+	auto& parent_table = *parent->page_table;
+	auto& child_table = *child->page_table;
+
+	for (uint32_t i = 0; i < Config::ptes_per_table; i++) {
+		PageTableEntry& pte = parent_table[i];
+
+		if (pte[PteField::Present] == 0)
+			continue;
+
+		// shared segments stay shared, see shm_fork
+		if (pte[PteField::Writable] && pte[PteSoftField::Shared] == 0) {
+			pte[PteField::Writable] = 0;
+			pte[PteSoftField::CopyOnWrite] = 1;
+		}
+
+		child_table[i] = pte;
+		child_table[i][PteField::Accessed] = 0;
+		child_table[i][PteField::Dirty] = 0;
+
+		frame_get(pte[PteField::PhyFrameID]);
+	}
+
+	return child;
+}
+
+Process* process_fork (Process *parent)
+{
+	if (parent == current)
+		context_save(parent);
+
+	Process *child;
+
+	switch (parent->vmem_mode) {
+		case VmemMode::BaseLimit:
+			child = fork_base_limit(parent);
+		break;
+
+		case VmemMode::Paging:
+			child = fork_paging(parent);
+		break;
+
+		default:
+			child = nullptr;
+	}
+
+	if (child != nullptr) {
+		child->gprs = parent->gprs;
+		child->pc = parent->pc;
+
+		if (child->vmem_mode == VmemMode::Paging) {
+			shm_fork(parent, child);
+			file_mmap_fork(parent, child);
+		}
+	}
+
+	return child;
+}
+
+bool process_handle_cow_fault (Process *process, const uint16_t vaddr)
+{
+	if (process->vmem_mode != VmemMode::Paging)
+		return false;
+
+	PageTableEntry& pte = (*process->page_table)[vaddr >> Config::page_size_bits];
+
+	if (pte[PteField::Present] == 0 || pte[PteSoftField::CopyOnWrite] == 0)
+		return false;
+
+	const uint16_t frame = pte[PteField::PhyFrameID];
+
+	// if we hold the last reference, the page can just become writable again
+	if (frame_refcount(frame) > 1) {
+		const auto new_frame = frame_alloc();
+
+		if (!new_frame)
+			return false;
+
+		frame_copy(*new_frame, frame);
+		frame_put(frame);
+
+		pte[PteField::PhyFrameID] = *new_frame;
+	}
+
+	pte[PteSoftField::CopyOnWrite] = 0;
+	pte[PteField::Writable] = 1;
+
+	return true;
+}
+
+void process_save (Lib::SnapshotWriter& out)
+{
+	out.put_section("processes");
+	out.put(next_pid);
+	out.put(preemptive);
+	out.put(quantum_timer_on);
+
+	const auto list = process_list();
+
+	out.put<uint32_t>(list.size());
+
+	for (const Process *process : list) {
+		out.put(process->pid);
+		out.put(process->parent_pid);
+		out.put(process->state);
+		out.put_string(process->name);
+		out.put(process->gprs);
+		out.put(process->pc);
+		out.put(process->vmem_mode);
+		out.put(process->vmem_paddr_base);
+		out.put(process->vmem_size);
+		out.put(process->page_table != nullptr);
+
+		if (process->page_table) {
+			for (const PageTableEntry& pte : *process->page_table)
+				out.put(pte.to_underlying());
+		}
+
+		out.put(process->stats);
+		out.put(process->accounted_cycles);
+		out.put(process->accounted_instructions);
+	}
+
+	out.put<uint32_t>(ready_queue.size());
+
+	for (const Process *process : ready_queue)
+		out.put(process->pid);
+
+	out.put((current == nullptr) ? invalid_pid : current->pid);
+}
+
+void process_restore (Lib::SnapshotReader& in)
+{
+	in.expect_section("processes");
+
+	processes.clear();
+	ready_queue.clear();
+	current = nullptr;
+
+	next_pid = in.get<uint16_t>();
+	preemptive = in.get<bool>();
+	quantum_timer_on = in.get<bool>();
+
+	const uint32_t nprocesses = in.get<uint32_t>();
+
+	for (uint32_t i = 0; i < nprocesses; i++) {
+		auto process = std::make_unique<Process>();
+		process->pid = in.get<uint16_t>();
+		process->parent_pid = in.get<uint16_t>();
+		process->state = in.get<Process::State>();
+		process->name = in.get_string();
+		process->gprs = in.get<decltype(process->gprs)>();
+		process->pc = in.get<uint16_t>();
+		process->vmem_mode = in.get<VmemMode>();
+		process->vmem_paddr_base = in.get<uint16_t>();
+		process->vmem_size = in.get<uint16_t>();
+
+		if (in.get<bool>()) {
+			process->page_table = std::make_unique<PageTable>();
+
+			for (PageTableEntry& pte : *process->page_table)
+				pte = PageTableEntry(in.get<uint32_t>());
+		}
+
+		process->stats = in.get<ProcessStats>();
+		process->accounted_cycles = in.get<uint64_t>();
+		process->accounted_instructions = in.get<uint64_t>();
+
+		const uint16_t pid = process->pid;
+		processes.insert(std::make_pair(pid, std::move(process)));
+	}
+
+	const uint32_t nready = in.get<uint32_t>();
+
+	for (uint32_t i = 0; i < nready; i++) {
+		Process *process = process_get(in.get<uint16_t>());
+		mylib_assert_exception(process != nullptr)
+		ready_queue.push_back(process);
+	}
+
+	if (const uint16_t pid = in.get<uint16_t>(); pid != invalid_pid) {
+		current = process_get(pid);
+		mylib_assert_exception(current != nullptr)
+		cpu->set_page_table(current->page_table.get());
+		cpu->set_context_id(current->pid);
+	}
+}
+
+void process_reset ()
+{
+	processes.clear();
+	ready_queue.clear();
+	current = nullptr;
+	next_pid = 1;
+	preemptive = true;
+	quantum_timer_on = true;
+}
+
+// ---------------------------------------
+
+void sched_add (Process *process)
+{
+	process->state = Process::State::Ready;
+	ready_queue.push_back(process);
+
+	if (process != current)
+		sched_update_quantum_timer(false);
+}
+
+void schedule ()
+{
+	if (current != nullptr) {
+		context_save(current);
+
+		if (current->state == Process::State::Running)
+			sched_add(current);
+
+		current = nullptr;
+	}
+
+	if (ready_queue.empty()) {
+		sched_update_quantum_timer(false);
+		cpu->halt();
+		cpu->get_computer().get_event_trace().begin_idle(cpu->get_computer().get_cycle());
+		return;
+	}
+
+	current = ready_queue.front();
+	ready_queue.pop_front();
+
+	current->state = Process::State::Running;
+	current->stats.context_switches++;
+	context_restore(current);
+
+	// the new process gets a whole quantum
+	sched_update_quantum_timer(true);
+}
+
+void sched_set_preemptive (const bool preemptive_)
+{
+	preemptive = preemptive_;
+	sched_update_quantum_timer(false);
+}
+
+bool sched_is_preemptive ()
+{
+	return preemptive;
+}
+
+// ---------------------------------------
+
+} // end namespace
@@ -0,0 +1,162 @@
+#ifndef __ARQSIM_HEADER_OS_PROCESS_H__
+#define __ARQSIM_HEADER_OS_PROCESS_H__
+
+#include <array>
+#include <memory>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <cstdint>
+
+#include <my-lib/std.h>
+#include <my-lib/macros.h>
+#include <my-lib/bit.h>
+
+#include "../config.h"
+#include "../snapshot.h"
+#include "../arch/arch.h"
+#include "os.h"
+
+namespace OS {
+
+// ---------------------------------------
+
+// The hardware ignores the bits of PteField::Foo,
+// so the kernel keeps its own per-page flags there.
+struct PteSoftField {
+	constexpr static Mylib::BitField CopyOnWrite = { 18, 1 };
+	constexpr static Mylib::BitField Shared = { 19, 1 }; // shm segment or file mapping, never copy-on-write
+};
+
+class WaitQueue;
+
+inline constexpr uint32_t cpu_exception_types = std::to_underlying(CpuException::Type::GPFinvalidInstruction) + 1;
+
+struct ProcessStats {
+	uint64_t cycles = 0; // busy cycles of the cpu while running the process
+	uint64_t instructions = 0;
+	std::array<uint64_t, cpu_exception_types> faults = {}; // by CpuException::Type
+	uint64_t syscalls = 0;
+	uint64_t disk_read_bytes = 0;
+	uint64_t disk_write_bytes = 0;
+	uint64_t context_switches = 0; // times it was dispatched
+};
+
+struct Process {
+	enum class State : uint16_t {
+		Ready          = 0,
+		Running        = 1,
+		Blocked        = 2,
+	};
+
+	uint16_t pid;
+	uint16_t parent_pid;
+	State state = State::Ready;
+	std::string name;
+
+	// saved context, valid while the process is not running
+	std::array<uint16_t, Config::nregs> gprs = {};
+	uint16_t pc = 0;
+
+	VmemMode vmem_mode = VmemMode::Paging;
+	uint16_t vmem_paddr_base = 0;
+	uint16_t vmem_size = 0;
+	std::unique_ptr<PageTable> page_table;
+
+	// blocking state, see wait.h
+	WaitQueue *wait_queue = nullptr;
+	bool sleeping = false;
+	uint64_t wake_cycle = 0;
+
+	ProcessStats stats;
+
+	// cpu counters when the stats were last updated
+	uint64_t accounted_cycles = 0;
+	uint64_t accounted_instructions = 0;
+};
+
+inline constexpr uint16_t invalid_pid = 0xFFFF;
+
+// ---------------------------------------
+
+Process* process_create (const std::string_view name, const uint16_t parent_pid);
+
+// releases all frames of the process and removes it from the scheduler
+void process_destroy (Process *process);
+
+// prints the reason in the kernel terminal, destroys the process and,
+// if it was running, schedules the next one
+void process_kill (Process *process, const std::string_view reason);
+
+Process* process_get (const uint16_t pid);
+Process* process_current ();
+
+// all processes, ordered by pid
+std::vector<Process*> process_list ();
+
+// brings the stats of the running process up to date
+void process_account_current ();
+
+// writes the register of the running process in the cpu, otherwise in its saved context
+void process_set_gpr (Process *process, const uint8_t code, const uint16_t value);
+
+// maps a frame the caller already holds a reference to
+void process_map_page (Process *process, const uint16_t vpage, const uint16_t frame, const bool readable, const bool writable, const bool executable);
+
+// drops the reference to the frame and clears the pte
+void process_unmap_page (Process *process, const uint16_t vpage);
+
+// Translates vaddr and returns the physical address in paddr and how many
+// words after it are physically contiguous in length.
+// Write access resolves copy-on-write pages.
+bool process_translate (Process *process, const uint16_t vaddr, const bool write, uint16_t& paddr, uint32_t& length);
+
+// Copy between kernel buffers and the address space of a process.
+// Translation is done once per page, not once per word.
+// Return false if any address is not accessible with the required permission.
+bool process_read_mem (Process *process, const uint16_t vaddr, std::span<uint16_t> buffer);
+bool process_write_mem (Process *process, const uint16_t vaddr, std::span<const uint16_t> buffer);
+
+// Returns false if any address of [vaddr, vaddr + size) is not accessible, without copying.
+bool process_check_mem (Process *process, const uint16_t vaddr, const uint32_t size, const bool write);
+
+// Copies between two address spaces, without a kernel buffer in between.
+bool process_copy_mem (Process *dest, const uint16_t dest_vaddr, Process *src, const uint16_t src_vaddr, const uint32_t size);
+
+// Paging: frames are shared copy-on-write.
+// BaseLimit: the whole address space is copied.
+// Returns nullptr if out of memory.
+Process* process_fork (Process *parent);
+
+// returns false if the fault is not a copy-on-write fault,
+// or if there is no memory to resolve it
+bool process_handle_cow_fault (Process *process, const uint16_t vaddr);
+
+// Processes and scheduler state. Blocking state is restored by the
+// owner of each queue. The running process gets its page table back
+// in the cpu, its registers are already there.
+void process_save (Lib::SnapshotWriter& out);
+void process_restore (Lib::SnapshotReader& in);
+
+// forgets the whole state, see OS::shutdown
+void process_reset ();
+
+// ---------------------------------------
+
+void sched_add (Process *process);
+
+// saves the current process (if any) and dispatches the next ready one,
+// halting the cpu if there is nothing to run
+void schedule ();
+
+// when disabled, processes run until they block, yield or exit
+void sched_set_preemptive (const bool preemptive);
+bool sched_is_preemptive ();
+
+// ---------------------------------------
+
+} // end namespace
+
+#endif
@@ -0,0 +1,250 @@
+#include <algorithm>
+#include <unordered_map>
+#include <vector>
+
+#include "../config.h"
+#include "../arch/arch.h"
+#include "os.h"
+#include "frames.h"
+#include "process.h"
+#include "syscall.h"
+#include "shm.h"
+
+namespace OS {
+
+// ---------------------------------------
+
+using PteField = Arch::Cpu::PteField;
+
+struct Segment {
+	// the segment holds a reference to each frame,
+	// and each attached process holds another one through its page table
+	std::vector<uint16_t> frames;
+	uint32_t attached = 0;
+	uint16_t creator = invalid_pid; // until it exits
+};
+
+struct Attachment {
+	uint16_t key;
+	uint16_t vaddr;
+};
+
+using SegmentMap = std::unordered_map<uint16_t, Segment>;
+
+static thread_local SegmentMap segments;
+static thread_local std::unordered_map<uint16_t, std::vector<Attachment>> attachments; // by pid
+
+// ---------------------------------------
+
+static SegmentMap::iterator segment_free (const SegmentMap::iterator it)
+{
+	for (const uint16_t frame : it->second.frames)
+		frame_put(frame);
+
+	return segments.erase(it);
+}
+
+static void segment_put (const uint16_t key)
+{
+	auto it = segments.find(key);
+
+	mylib_assert_exception(it != segments.end())
+	mylib_assert_exception(it->second.attached > 0)
+
+	it->second.attached--;
+
+	if (it->second.attached == 0)
+		segment_free(it);
+}
+
+static void unmap_segment (Process *process, const Attachment& attachment)
+{
+	const Segment& segment = segments.at(attachment.key);
+	const uint16_t first_vpage = attachment.vaddr >> Config::page_size_bits;
+
+	for (uint32_t i = 0; i < segment.frames.size(); i++)
+		process_unmap_page(process, first_vpage + i);
+
+	segment_put(attachment.key);
+}
+
+// ---------------------------------------
+
+SyscallResult shm_get (Process *process, const SyscallArgs& args)
+{
+	const uint32_t npages = (static_cast<uint32_t>(args.r2) + Config::page_size - 1) / Config::page_size;
+
+	if (npages == 0)
+		return syscall_error;
+
+	const auto it = segments.find(args.r1);
+
+	if (it != segments.end())
+		return (npages <= it->second.frames.size()) ? SyscallResult(args.r1) : SyscallResult(syscall_error);
+
+	Segment segment;
+	segment.creator = process->pid;
+	segment.frames.reserve(npages);
+
+	for (uint32_t i = 0; i < npages; i++) {
+		const auto frame = frame_alloc();
+
+		if (!frame) {
+			for (const uint16_t f : segment.frames)
+				frame_put(f);
+			return syscall_error;
+		}
+
+		frame_zero(*frame);
+		segment.frames.push_back(*frame);
+	}
+
+	segments.insert(std::make_pair(args.r1, std::move(segment)));
+
+	return args.r1;
+}
+
+SyscallResult shm_attach (Process *process, const SyscallArgs& args)
+{
+	const auto it = segments.find(args.r1);
+
+	if (it == segments.end() || process->vmem_mode != VmemMode::Paging)
+		return syscall_error;
+
+	Segment& segment = it->second;
+	const uint16_t vaddr = args.r2;
+	const uint32_t first_vpage = vaddr >> Config::page_size_bits;
+
+	if ((vaddr % Config::page_size) != 0 || first_vpage + segment.frames.size() > Config::ptes_per_table)
+		return syscall_error;
+
+	for (uint32_t i = 0; i < segment.frames.size(); i++) {
+		if ((*process->page_table)[first_vpage + i][PteField::Present])
+			return syscall_error;
+	}
+
+	for (uint32_t i = 0; i < segment.frames.size(); i++) {
+		frame_get(segment.frames[i]);
+		process_map_page(process, first_vpage + i, segment.frames[i], true, args.r3 & ShmFlags::Writable, args.r3 & ShmFlags::Executable);
+		(*process->page_table)[first_vpage + i][PteSoftField::Shared] = 1;
+	}
+
+	segment.attached++;
+	attachments[process->pid].push_back(Attachment {
+		.key = args.r1,
+		.vaddr = vaddr
+		});
+
+	return segment.frames.size() * Config::page_size;
+}
+
+SyscallResult shm_detach (Process *process, const SyscallArgs& args)
+{
+	auto it = attachments.find(process->pid);
+
+	if (it == attachments.end())
+		return syscall_error;
+
+	auto& list = it->second;
+	const auto attachment = std::ranges::find(list, args.r1, &Attachment::vaddr);
+
+	if (attachment == list.end())
+		return syscall_error;
+
+	unmap_segment(process, *attachment);
+	list.erase(attachment);
+
+	return 0;
+}
+
+void shm_fork (Process *parent, Process *child)
+{
+	const auto it = attachments.find(parent->pid);
+
+	if (it == attachments.end())
+		return;
+
+	const std::vector<Attachment> list = it->second;
+
+	for (const Attachment& attachment : list)
+		segments.at(attachment.key).attached++;
+
+	attachments[child->pid] = list;
+}
+
+void shm_release (Process *process)
+{
+	const auto it = attachments.find(process->pid);
+
+	if (it != attachments.end()) {
+		for (const Attachment& attachment : it->second)
+			unmap_segment(process, attachment);
+
+		attachments.erase(it);
+	}
+
+	// created but never attached, or no longer, nobody else would free them
+	for (auto seg = segments.begin(); seg != segments.end(); ) {
+		if (seg->second.creator != process->pid)
+			++seg;
+		else if (seg->second.attached == 0)
+			seg = segment_free(seg);
+		else {
+			seg->second.creator = invalid_pid;
+			++seg;
+		}
+	}
+}
+
+void shm_save (Lib::SnapshotWriter& out)
+{
+	out.put_section("shm");
+	out.put<uint32_t>(segments.size());
+
+	for (const auto& [key, segment] : segments) {
+		out.put(key);
+		out.put_vector(segment.frames);
+		out.put(segment.attached);
+		out.put(segment.creator);
+	}
+
+	out.put<uint32_t>(attachments.size());
+
+	for (const auto& [pid, list] : attachments) {
+		out.put(pid);
+		out.put_vector(list);
+	}
+}
+
+void shm_restore (Lib::SnapshotReader& in)
+{
+	in.expect_section("shm");
+	segments.clear();
+	attachments.clear();
+
+	const uint32_t nsegments = in.get<uint32_t>();
+
+	for (uint32_t i = 0; i < nsegments; i++) {
+		Segment& segment = segments[in.get<uint16_t>()];
+		segment.frames = in.get_vector<uint16_t>();
+		segment.attached = in.get<uint32_t>();
+		segment.creator = in.get<uint16_t>();
+	}
+
+	const uint32_t nattached = in.get<uint32_t>();
+
+	for (uint32_t i = 0; i < nattached; i++) {
+		const uint16_t pid = in.get<uint16_t>();
+		attachments[pid] = in.get_vector<Attachment>();
+	}
+}
+
+void shm_reset ()
+{
+	segments.clear();
+	attachments.clear();
+}
+
+// ---------------------------------------
+
+} // end namespace
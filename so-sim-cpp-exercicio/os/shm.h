@@ -0,0 +1,63 @@
+#ifndef __ARQSIM_HEADER_OS_SHM_H__
+#define __ARQSIM_HEADER_OS_SHM_H__
+
+#include <cstdint>
+
+#include <my-lib/std.h>
+#include <my-lib/macros.h>
+
+#include "../config.h"
+#include "../snapshot.h"
+#include "../arch/arch.h"
+#include "os.h"
+#include "syscall.h"
+
+namespace OS {
+
+// ---------------------------------------
+
+/*
+	Shared memory segments.
+
+	A segment is a set of frames identified by a key chosen by the processes.
+	Attaching maps the same frames in the page table of each process,
+	so data is shared without copies. Only paged processes can attach.
+	The segment is released when the last process detaches from it,
+	either explicitly or by exiting, or when the process that created it
+	exits while nobody is attached.
+	Forked children inherit the attachments of the parent.
+*/
+
+struct ShmFlags {
+	static constexpr uint16_t Writable = 1 << 0;
+	static constexpr uint16_t Executable = 1 << 1;
+};
+
+struct Process;
+
+// r1 = key, r2 = size in words; creates the segment if it doesn't exist; returns the key
+SyscallResult shm_get (Process *process, const SyscallArgs& args);
+
+// r1 = key, r2 = page aligned vaddr, r3 = ShmFlags; returns the segment size in words
+SyscallResult shm_attach (Process *process, const SyscallArgs& args);
+
+// r1 = vaddr where the segment was attached
+SyscallResult shm_detach (Process *process, const SyscallArgs& args);
+
+// the child shares the attachments of the parent, called after the page table is copied
+void shm_fork (Process *parent, Process *child);
+
+// called when the process is destroyed, before its frames are released
+void shm_release (Process *process);
+
+void shm_save (Lib::SnapshotWriter& out);
+void shm_restore (Lib::SnapshotReader& in);
+
+// forgets the whole state, see OS::shutdown
+void shm_reset ();
+
+// ---------------------------------------
+
+} // end namespace
+
+#endif
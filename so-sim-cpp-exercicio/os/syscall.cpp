@@ -0,0 +1,320 @@
+#include <algorithm>
+#include <array>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "../config.h"
+#include "../arch/arch.h"
+#include "os.h"
+#include "os-lib.h"
+#include "process.h"
+#include "syscall.h"
+#include "wait.h"
+#include "loader.h"
+#include "ipc.h"
+#include "shm.h"
+#include "file.h"
+
+namespace OS {
+
+// ---------------------------------------
+
+using SyscallHandler = SyscallResult (*) (Process *process, const SyscallArgs& args);
+
+struct SyscallEntry {
+	const char *name = nullptr;
+	SyscallHandler handler = nullptr;
+};
+
+// typed keys stay in the terminal until a process reads them
+static thread_local WaitQueue keyboard_wait;
+
+static thread_local bool trace = false;
+
+// ---------------------------------------
+
+static SyscallResult sys_exit (Process *process, const SyscallArgs& args)
+{
+	terminal_println(cpu, Arch::Terminal::Type::Kernel, "process ", process->pid, " exited with code ", args.r1);
+
+	process_destroy(process);
+	schedule();
+
+	return std::nullopt;
+}
+
+static SyscallResult sys_fork (Process *process, const SyscallArgs& args)
+{
+	Process *child = process_fork(process);
+
+	if (child == nullptr)
+		return syscall_error;
+
+	child->gprs[0] = 0;
+	sched_add(child);
+
+	return child->pid;
+}
+
+static SyscallResult sys_print_str (Process *process, const SyscallArgs& args)
+{
+	std::vector<uint16_t> buffer(args.r2);
+
+	if (!process_read_mem(process, args.r1, buffer))
+		return syscall_error;
+
+	std::string str;
+	str.reserve(buffer.size());
+
+	for (const uint16_t c : buffer)
+		str += static_cast<char>(c);
+
+	terminal_print_str(cpu, Terminal::App, str);
+
+	return args.r2;
+}
+
+static SyscallResult sys_read_char (Process *process, const SyscallArgs& args)
+{
+	if (cpu->read_io(IO_Port::TerminalTypedCount) == 0)
+		return syscall_wait_and_restart(process, keyboard_wait);
+
+	return cpu->read_io(IO_Port::TerminalReadTypedChar);
+}
+
+// The terminal copies the keys straight into the process memory,
+// one physically contiguous chunk at a time.
+static SyscallResult sys_read_str (Process *process, const SyscallArgs& args)
+{
+	if (args.r2 == 0)
+		return 0;
+
+	if (cpu->read_io(IO_Port::TerminalTypedCount) == 0)
+		return syscall_wait_and_restart(process, keyboard_wait);
+
+	uint32_t done = 0;
+
+	while (done < args.r2) {
+		uint16_t paddr;
+		uint32_t length;
+
+		if (!process_translate(process, args.r1 + done, true, paddr, length))
+			return syscall_error;
+
+		length = std::min<uint32_t>(length, args.r2 - done);
+
+		cpu->write_io(IO_Port::TerminalDmaAddr, paddr);
+		cpu->write_io(IO_Port::TerminalDmaRead, length);
+
+		const uint16_t amount = cpu->read_io(IO_Port::TerminalDmaRead);
+		done += amount;
+
+		if (amount < length)
+			break;
+	}
+
+	return done;
+}
+
+static SyscallResult sys_yield (Process *process, const SyscallArgs& args)
+{
+	schedule();
+	return 0;
+}
+
+static SyscallResult sys_sleep (Process *process, const SyscallArgs& args)
+{
+	if (args.r1 == 0)
+		return 0;
+
+	// a tick is still the interval of the quantum timer, even when it is stopped
+	const uint64_t tick_cycles = cpu->read_io(IO_Port::TimerInterruptCycles);
+
+	sleep_until(process, read_io_u64(cpu, IO_Port::TimerCycles0) + args.r1 * tick_cycles);
+
+	return 0;
+}
+
+static SyscallResult sys_get_time (Process *process, const SyscallArgs& args)
+{
+	return cpu->read_io(IO_Port::TimerGetTimeSeconds);
+}
+
+static SyscallResult write_u64 (Process *process, const uint16_t vaddr, const uint64_t value)
+{
+	const std::array<uint16_t, 4> words = {
+		static_cast<uint16_t>(value),
+		static_cast<uint16_t>(value >> 16),
+		static_cast<uint16_t>(value >> 32),
+		static_cast<uint16_t>(value >> 48)
+		};
+
+	if (!process_write_mem(process, vaddr, words))
+		return syscall_error;
+
+	return 0;
+}
+
+static SyscallResult sys_get_cycles (Process *process, const SyscallArgs& args)
+{
+	return write_u64(process, args.r1, read_io_u64(cpu, IO_Port::TimerCycles0));
+}
+
+static SyscallResult sys_get_time_us (Process *process, const SyscallArgs& args)
+{
+	return write_u64(process, args.r1, read_io_u64(cpu, IO_Port::TimerTimeUs0));
+}
+
+static SyscallResult sys_spawn (Process *process, const SyscallArgs& args)
+{
+	std::vector<uint16_t> buffer(args.r2);
+
+	if (!process_read_mem(process, args.r1, buffer))
+		return syscall_error;
+
+	const std::string fname(buffer.begin(), buffer.end());
+	Process *child = load_program(fname, default_vmem_mode, process->pid);
+
+	if (child == nullptr)
+		return syscall_error;
+
+	sched_add(child);
+
+	return child->pid;
+}
+
+// ---------------------------------------
+
+static constexpr auto syscall_table = [] () consteval {
+	std::array<SyscallEntry, std::to_underlying(Syscall::Count)> table;
+
+	auto add = [&table] (const Syscall number, const char *name, const SyscallHandler handler) {
+		table[ std::to_underlying(number) ] = SyscallEntry {
+			.name = name,
+			.handler = handler
+			};
+	};
+
+	add(Syscall::Exit, "exit", sys_exit);
+	add(Syscall::Fork, "fork", sys_fork);
+	add(Syscall::PrintStr, "print_str", sys_print_str);
+	add(Syscall::ReadChar, "read_char", sys_read_char);
+	add(Syscall::OpenFile, "open_file", file_open);
+	add(Syscall::ReadFile, "read_file", file_read);
+	add(Syscall::CloseFile, "close_file", file_close);
+	add(Syscall::Yield, "yield", sys_yield);
+	add(Syscall::Sleep, "sleep", sys_sleep);
+	add(Syscall::GetTime, "get_time", sys_get_time);
+	add(Syscall::Spawn, "spawn", sys_spawn);
+	add(Syscall::ReadStr, "read_str", sys_read_str);
+	add(Syscall::Send, "send", ipc_send);
+	add(Syscall::Receive, "receive", ipc_receive);
+	add(Syscall::ShmGet, "shm_get", shm_get);
+	add(Syscall::ShmAttach, "shm_attach", shm_attach);
+	add(Syscall::ShmDetach, "shm_detach", shm_detach);
+	add(Syscall::WriteFile, "write_file", file_write);
+	add(Syscall::SeekFile, "seek_file", file_seek);
+	add(Syscall::Mmap, "mmap", file_mmap);
+	add(Syscall::Munmap, "munmap", file_munmap);
+	add(Syscall::GetCycles, "get_cycles", sys_get_cycles);
+	add(Syscall::GetTimeUs, "get_time_us", sys_get_time_us);
+
+	for (const auto& entry : table) {
+		if (entry.handler == nullptr)
+			throw "syscall without handler";
+	}
+
+	return table;
+}();
+
+// ---------------------------------------
+
+void syscall ()
+{
+	Process *process = process_current();
+
+	mylib_assert_exception(process != nullptr)
+
+	const uint16_t number = cpu->get_gpr(0);
+
+	process->stats.syscalls++;
+
+	if (number >= syscall_table.size()) {
+		process_kill(process, "invalid syscall");
+		return;
+	}
+
+	const SyscallArgs args = {
+		.r1 = cpu->get_gpr(1),
+		.r2 = cpu->get_gpr(2),
+		.r3 = cpu->get_gpr(3)
+		};
+
+	if (trace)
+		terminal_println(cpu, Terminal::Kernel, "pid ", process->pid, ": ", syscall_table[number].name, "(", args.r1, ", ", args.r2, ", ", args.r3, ")");
+
+	if (Arch::EventTrace& event_trace = cpu->get_computer().get_event_trace(); event_trace.is_on())
+		event_trace.instant(cpu->get_computer().get_cycle(), Arch::TraceTrack::Cpu, syscall_table[number].name, "syscall", "pid", process->pid);
+
+	const SyscallResult result = syscall_table[number].handler(process, args);
+
+	if (result)
+		process_set_gpr(process, 0, *result);
+}
+
+SyscallResult syscall_wait_and_restart (Process *process, WaitQueue& queue)
+{
+	// before the wait, which may switch processes and account the instructions
+	cpu->restart_syscall();
+	process->stats.syscalls--;
+	queue.wait(process);
+	return std::nullopt;
+}
+
+// ---------------------------------------
+
+void syscall_keyboard_interrupt ()
+{
+	// The terminal won't interrupt again until all keys are read,
+	// so every reader must get the chance to read them.
+	keyboard_wait.wake_all();
+}
+
+// ---------------------------------------
+
+void syscall_set_trace (const bool trace_)
+{
+	trace = trace_;
+}
+
+bool syscall_is_traced ()
+{
+	return trace;
+}
+
+// ---------------------------------------
+
+void syscall_save (Lib::SnapshotWriter& out)
+{
+	out.put_section("syscall");
+	keyboard_wait.save(out);
+	out.put(trace);
+}
+
+void syscall_restore (Lib::SnapshotReader& in)
+{
+	in.expect_section("syscall");
+	keyboard_wait.restore(in);
+	trace = in.get<bool>();
+}
+
+void syscall_reset ()
+{
+	keyboard_wait.clear();
+	trace = false;
+}
+
+// ---------------------------------------
+
+} // end namespace
@@ -0,0 +1,63 @@
+#ifndef __ARQSIM_HEADER_OS_SYSCALL_H__
+#define __ARQSIM_HEADER_OS_SYSCALL_H__
+
+#include <optional>
+
+#include <cstdint>
+
+#include <my-lib/std.h>
+#include <my-lib/macros.h>
+
+#include "../config.h"
+#include "../snapshot.h"
+#include "../arch/arch.h"
+#include "os.h"
+
+namespace OS {
+
+// ---------------------------------------
+
+struct Process;
+class WaitQueue;
+
+struct SyscallArgs {
+	uint16_t r1;
+	uint16_t r2;
+	uint16_t r3;
+};
+
+// std::nullopt means that r0 must not be touched,
+// either because the result is delivered later or because the process is gone
+using SyscallResult = std::optional<uint16_t>;
+
+// Blocks the process and moves it back to the syscall instruction,
+// so that the syscall is issued again when it is woken up.
+// Only the attempt that completes is counted, see Cpu::restart_syscall.
+SyscallResult syscall_wait_and_restart (Process *process, WaitQueue& queue);
+
+// ---------------------------------------
+
+// Called by the interrupt handler to complete blocking syscalls.
+
+void syscall_keyboard_interrupt ();
+
+// ---------------------------------------
+
+// prints every syscall in the kernel terminal
+void syscall_set_trace (const bool trace);
+bool syscall_is_traced ();
+
+// ---------------------------------------
+
+// processes waiting for keys, and the trace setting
+void syscall_save (Lib::SnapshotWriter& out);
+void syscall_restore (Lib::SnapshotReader& in);
+
+// forgets the whole state, see OS::shutdown
+void syscall_reset ();
+
+// ---------------------------------------
+
+} // end namespace
+
+#endif
@@ -0,0 +1,180 @@
+#include <map>
+
+#include "../config.h"
+#include "../arch/arch.h"
+#include "os.h"
+#include "os-lib.h"
+#include "process.h"
+#include "wait.h"
+
+namespace OS {
+
+// ---------------------------------------
+
+static thread_local std::multimap<uint64_t, Process*> sleep_queue;
+
+// ---------------------------------------
+
+// one-shot at the earliest wake-up, instead of checking at every tick
+static void sleep_program_timer (const uint64_t now)
+{
+	if (sleep_queue.empty())
+		timer_set_channel_mode(cpu, timer_channel_sleep, Arch::TimerMode::Off);
+	else {
+		const uint64_t wake_cycle = sleep_queue.begin()->first;
+		timer_program_channel(cpu, timer_channel_sleep, Arch::TimerMode::OneShot, (wake_cycle > now) ? (wake_cycle - now) : 1);
+	}
+}
+
+// ---------------------------------------
+
+void WaitQueue::wait (Process *process)
+{
+	mylib_assert_exception(process == process_current())
+	mylib_assert_exception(process->wait_queue == nullptr)
+
+	process->state = Process::State::Blocked;
+	process->wait_queue = this;
+	this->processes.push_back(process);
+
+	schedule();
+}
+
+Process* WaitQueue::wake_one ()
+{
+	if (this->processes.empty())
+		return nullptr;
+
+	Process *process = this->processes.front();
+	this->processes.pop_front();
+
+	process->wait_queue = nullptr;
+	sched_add(process);
+
+	return process;
+}
+
+void WaitQueue::wake_all ()
+{
+	while (this->wake_one() != nullptr);
+}
+
+void WaitQueue::remove (Process *process)
+{
+	this->processes.remove(process);
+	process->wait_queue = nullptr;
+}
+
+void WaitQueue::save (Lib::SnapshotWriter& out) const
+{
+	out.put<uint32_t>(this->processes.size());
+
+	for (const Process *process : this->processes)
+		out.put(process->pid);
+}
+
+void WaitQueue::restore (Lib::SnapshotReader& in)
+{
+	this->processes.clear();
+
+	const uint32_t n = in.get<uint32_t>();
+
+	for (uint32_t i = 0; i < n; i++) {
+		Process *process = process_get(in.get<uint16_t>());
+		mylib_assert_exception(process != nullptr)
+
+		process->wait_queue = this;
+		this->processes.push_back(process);
+	}
+}
+
+// ---------------------------------------
+
+void sleep_until (Process *process, const uint64_t wake_cycle)
+{
+	mylib_assert_exception(process == process_current())
+
+	const uint64_t now = read_io_u64(cpu, IO_Port::TimerCycles0);
+
+	process->state = Process::State::Blocked;
+	process->wake_cycle = wake_cycle;
+	process->sleeping = true;
+	const auto it = sleep_queue.insert(std::make_pair(wake_cycle, process));
+
+	if (it == sleep_queue.begin())
+		sleep_program_timer(now);
+
+	schedule();
+}
+
+void sleep_queue_tick (const uint64_t now)
+{
+	while (!sleep_queue.empty() && sleep_queue.begin()->first <= now) {
+		Process *process = sleep_queue.begin()->second;
+		sleep_queue.erase(sleep_queue.begin());
+
+		process->sleeping = false;
+		sched_add(process);
+	}
+
+	sleep_program_timer(now);
+}
+
+void sleep_queue_save (Lib::SnapshotWriter& out)
+{
+	out.put_section("sleep");
+	out.put<uint32_t>(sleep_queue.size());
+
+	for (const auto& [wake_cycle, process] : sleep_queue) {
+		out.put(wake_cycle);
+		out.put(process->pid);
+	}
+}
+
+void sleep_queue_restore (Lib::SnapshotReader& in)
+{
+	in.expect_section("sleep");
+	sleep_queue.clear();
+
+	const uint32_t n = in.get<uint32_t>();
+
+	for (uint32_t i = 0; i < n; i++) {
+		const uint64_t wake_cycle = in.get<uint64_t>();
+		Process *process = process_get(in.get<uint16_t>());
+		mylib_assert_exception(process != nullptr)
+
+		process->sleeping = true;
+		process->wake_cycle = wake_cycle;
+		sleep_queue.insert(std::make_pair(wake_cycle, process));
+	}
+}
+
+void sleep_queue_reset ()
+{
+	sleep_queue.clear();
+}
+
+// ---------------------------------------
+
+void wait_cancel (Process *process)
+{
+	if (process->wait_queue != nullptr)
+		process->wait_queue->remove(process);
+
+	if (process->sleeping) {
+		auto [it, end] = sleep_queue.equal_range(process->wake_cycle);
+
+		for (; it != end; ++it) {
+			if (it->second == process) {
+				sleep_queue.erase(it);
+				break;
+			}
+		}
+
+		process->sleeping = false;
+	}
+}
+
+// ---------------------------------------
+
+} // end namespace
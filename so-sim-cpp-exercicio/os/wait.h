@@ -0,0 +1,81 @@
+#ifndef __ARQSIM_HEADER_OS_WAIT_H__
+#define __ARQSIM_HEADER_OS_WAIT_H__
+
+#include <list>
+
+#include <cstdint>
+
+#include <my-lib/std.h>
+#include <my-lib/macros.h>
+
+#include "../config.h"
+#include "../snapshot.h"
+#include "os.h"
+
+namespace OS {
+
+// ---------------------------------------
+
+struct Process;
+
+// Processes blocked on a device or event, woken up in FIFO order.
+class WaitQueue
+{
+private:
+	std::list<Process*> processes;
+
+public:
+	// blocks the process, which must be the running one, and schedules
+	void wait (Process *process);
+
+	// returns the woken process, or nullptr if the queue is empty
+	Process* wake_one ();
+
+	void wake_all ();
+
+	// used when the process is destroyed while waiting
+	void remove (Process *process);
+
+	// forgets the processes, which are being destroyed with the whole kernel
+	inline void clear ()
+	{
+		this->processes.clear();
+	}
+
+	inline bool empty () const
+	{
+		return this->processes.empty();
+	}
+
+	// processes are saved by pid, so they must be restored before the queue
+	void save (Lib::SnapshotWriter& out) const;
+	void restore (Lib::SnapshotReader& in);
+};
+
+// ---------------------------------------
+
+// Timed sleep, ordered by wake-up cycle. The sleep timer channel
+// is programmed to fire only at the earliest wake-up.
+
+void sleep_until (Process *process, const uint64_t wake_cycle);
+
+// wakes up every process whose wake-up cycle is <= now,
+// called when the sleep timer channel fires
+void sleep_queue_tick (const uint64_t now);
+
+void sleep_queue_save (Lib::SnapshotWriter& out);
+void sleep_queue_restore (Lib::SnapshotReader& in);
+
+// forgets the whole state, see OS::shutdown
+void sleep_queue_reset ();
+
+// ---------------------------------------
+
+// Removes the process from whatever wait/sleep queue it is in.
+void wait_cancel (Process *process);
+
+// ---------------------------------------
+
+} // end namespace
+
+#endif
@@ -0,0 +1,134 @@
+#ifndef __ARQSIM_HEADER_RING_BUFFER_H__
+#define __ARQSIM_HEADER_RING_BUFFER_H__
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <optional>
+#include <span>
+
+#include <cstdint>
+
+namespace Lib {
+
+// ---------------------------------------
+
+/*
+	Bounded lock-free ring buffer for exactly one producer thread
+	and one consumer thread (they may be the same thread).
+	head and tail run freely and wrap around, the index in the
+	buffer is taken with a mask, so capacity must be a power of 2.
+*/
+
+template <typename T, uint32_t capacity>
+class SpscRingBuffer
+{
+	static_assert(capacity > 0 && (capacity & (capacity - 1)) == 0, "capacity must be a power of 2");
+
+private:
+	static constexpr uint32_t mask = capacity - 1;
+
+	std::array<T, capacity> buffer;
+
+	// in different cache lines, so producer and consumer don't bounce them
+	alignas(64) std::atomic<uint32_t> head = 0; // next to pop, written by the consumer
+	alignas(64) std::atomic<uint32_t> tail = 0; // next to push, written by the producer
+
+public:
+	// producer side
+
+	// returns how many elements were pushed, less than data.size() if full
+	uint32_t push (const std::span<const T> data)
+	{
+		const uint32_t t = this->tail.load(std::memory_order_relaxed);
+		const uint32_t h = this->head.load(std::memory_order_acquire);
+		const uint32_t n = std::min<uint32_t>(data.size(), capacity - (t - h));
+
+		for (uint32_t i = 0; i < n; i++)
+			this->buffer[(t + i) & mask] = data[i];
+
+		this->tail.store(t + n, std::memory_order_release);
+
+		return n;
+	}
+
+	bool push (const T& value)
+	{
+		return this->push(std::span<const T>(&value, 1)) == 1;
+	}
+
+	// consumer side
+
+	// returns how many elements were popped, less than data.size() if empty
+	uint32_t pop (const std::span<T> data)
+	{
+		const uint32_t h = this->head.load(std::memory_order_relaxed);
+		const uint32_t t = this->tail.load(std::memory_order_acquire);
+		const uint32_t n = std::min<uint32_t>(data.size(), t - h);
+
+		for (uint32_t i = 0; i < n; i++)
+			data[i] = this->buffer[(h + i) & mask];
+
+		this->head.store(h + n, std::memory_order_release);
+
+		return n;
+	}
+
+	std::optional<T> pop ()
+	{
+		T value;
+
+		if (this->pop(std::span<T>(&value, 1)) == 0)
+			return std::nullopt;
+
+		return value;
+	}
+
+	// copies the first elements, left in the buffer, returns how many were copied
+	uint32_t peek (const std::span<T> data) const
+	{
+		const uint32_t h = this->head.load(std::memory_order_relaxed);
+		const uint32_t t = this->tail.load(std::memory_order_acquire);
+		const uint32_t n = std::min<uint32_t>(data.size(), t - h);
+
+		for (uint32_t i = 0; i < n; i++)
+			data[i] = this->buffer[(h + i) & mask];
+
+		return n;
+	}
+
+	// the next element, left in the buffer
+	std::optional<T> peek () const
+	{
+		const uint32_t h = this->head.load(std::memory_order_relaxed);
+		const uint32_t t = this->tail.load(std::memory_order_acquire);
+
+		if (t == h)
+			return std::nullopt;
+
+		return this->buffer[h & mask];
+	}
+
+	// either side, may be outdated as soon as it returns
+
+	uint32_t size () const
+	{
+		return this->tail.load(std::memory_order_acquire) - this->head.load(std::memory_order_acquire);
+	}
+
+	bool empty () const
+	{
+		return this->size() == 0;
+	}
+
+	bool full () const
+	{
+		return this->size() == capacity;
+	}
+};
+
+// ---------------------------------------
+
+} // end namespace
+
+#endif
@@ -0,0 +1,214 @@
+#ifndef __ARQSIM_HEADER_SNAPSHOT_H__
+#define __ARQSIM_HEADER_SNAPSHOT_H__
+
+#include <istream>
+#include <optional>
+#include <ostream>
+#include <span>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+#include <cstdint>
+
+#include <my-lib/std.h>
+#include <my-lib/macros.h>
+
+namespace Lib {
+
+// ---------------------------------------
+
+/*
+	Binary streams used by the machine snapshots.
+	Values are written as raw host bytes, so a snapshot can only be
+	restored by a simulator built for a host with the same endianness.
+	Every component starts with a named section, so a snapshot from
+	a different build fails early instead of restoring garbage.
+*/
+
+inline constexpr std::string_view snapshot_magic = "ARQSNAP";
+inline constexpr uint32_t snapshot_version = 8;
+
+// a snapshot followed by the changes of each checkpoint, see Arch::Computer::start_checkpoints
+inline constexpr std::string_view checkpoint_magic = "ARQCHECK";
+
+// blocks that may be mapped from the file start at this offset, usual host page size
+inline constexpr uint32_t snapshot_map_alignment = 4096;
+
+template <typename T>
+concept SnapshotValue = std::is_trivially_copyable_v<T>;
+
+class SnapshotWriter
+{
+private:
+	std::ostream& out;
+
+public:
+	SnapshotWriter (std::ostream& out)
+		: out(out)
+	{
+	}
+
+	template <SnapshotValue T>
+	void put (const T& value)
+	{
+		this->out.write(reinterpret_cast<const char*>(&value), sizeof(T));
+	}
+
+	// the size is not written
+	template <SnapshotValue T>
+	void put_span (const std::span<const T> data)
+	{
+		this->out.write(reinterpret_cast<const char*>(data.data()), data.size_bytes());
+	}
+
+	template <SnapshotValue T>
+	void put_vector (const std::vector<T>& data)
+	{
+		this->put<uint32_t>(data.size());
+		this->put_span(std::span<const T>(data));
+	}
+
+	void put_string (const std::string_view str)
+	{
+		this->put<uint32_t>(str.size());
+		this->out.write(str.data(), str.size());
+	}
+
+	void put_section (const std::string_view name)
+	{
+		this->put_string(name);
+	}
+
+	// pads with zeros up to a multiple of alignment
+	void align (const uint32_t alignment)
+	{
+		const uint64_t pos = this->out.tellp();
+
+		for (uint64_t i = pos; i % alignment != 0; i++)
+			this->put<uint8_t>(0);
+	}
+
+	// size and bytes, see SnapshotReader::get_record
+	void put_record (const std::string_view payload)
+	{
+		this->put<uint64_t>(payload.size());
+		this->out.write(payload.data(), payload.size());
+	}
+
+	// raises Mylib::Exception if anything could not be written
+	void check () const
+	{
+		mylib_assert_exception_msg(this->out.good(), "error writing snapshot")
+	}
+};
+
+// Raises Mylib::Exception if the stream ends early or a section does not match.
+class SnapshotReader
+{
+private:
+	std::istream& in;
+	int fd; // of the file being read, -1 if not a file
+
+public:
+	// fd allows large blocks to be mapped from the file instead of copied
+	SnapshotReader (std::istream& in, const int fd = -1)
+		: in(in), fd(fd)
+	{
+	}
+
+	inline int get_fd () const
+	{
+		return this->fd;
+	}
+
+	uint64_t tell ()
+	{
+		return this->in.tellg();
+	}
+
+	void skip (const uint64_t size)
+	{
+		this->in.seekg(size, std::ios::cur);
+		mylib_assert_exception_msg(this->in.good(), "snapshot truncated")
+	}
+
+	// skips the padding written by SnapshotWriter::align
+	void align (const uint32_t alignment)
+	{
+		const uint64_t pos = this->tell();
+
+		if (pos % alignment != 0)
+			this->skip(alignment - (pos % alignment));
+	}
+
+	template <SnapshotValue T>
+	T get ()
+	{
+		T value;
+		this->read(&value, sizeof(T));
+		return value;
+	}
+
+	template <SnapshotValue T>
+	void get_span (const std::span<T> data)
+	{
+		this->read(data.data(), data.size_bytes());
+	}
+
+	template <SnapshotValue T>
+	std::vector<T> get_vector ()
+	{
+		std::vector<T> data(this->get<uint32_t>());
+		this->get_span(std::span<T>(data));
+		return data;
+	}
+
+	std::string get_string ()
+	{
+		std::string str(this->get<uint32_t>(), '\0');
+		this->read(str.data(), str.size());
+		return str;
+	}
+
+	// The next record written by SnapshotWriter::put_record. std::nullopt at
+	// the end of the stream, or if the record was cut short, as happens
+	// when the writer dies while appending it.
+	std::optional<std::string> get_record ()
+	{
+		uint64_t size;
+
+		this->in.read(reinterpret_cast<char*>(&size), sizeof(size));
+
+		if (static_cast<std::size_t>(this->in.gcount()) != sizeof(size))
+			return std::nullopt;
+
+		std::string payload(size, '\0');
+		this->in.read(payload.data(), size);
+
+		if (static_cast<uint64_t>(this->in.gcount()) != size)
+			return std::nullopt;
+
+		return payload;
+	}
+
+	void expect_section (const std::string_view name)
+	{
+		const std::string found = this->get_string();
+		mylib_assert_exception_msg(found == name, "snapshot corrupted, expected section ", name, " found ", found)
+	}
+
+private:
+	void read (void *data, const std::size_t size)
+	{
+		this->in.read(static_cast<char*>(data), size);
+		mylib_assert_exception_msg(static_cast<std::size_t>(this->in.gcount()) == size, "snapshot truncated")
+	}
+};
+
+// ---------------------------------------
+
+} // end namespace
+
+#endif